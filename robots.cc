@@ -26,58 +26,46 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "absl/base/macros.h"
 #include "absl/container/fixed_array.h"
+#include "absl/container/inlined_vector.h"
 #include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
 #include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 // Allow for typos such as DISALOW in robots.txt.
 static bool kAllowFrequentTypos = true;
 
 namespace googlebot {
 
-// A RobotsMatchStrategy defines a strategy for matching individual lines in a
-// robots.txt file. Each Match* method should return a match priority, which is
-// interpreted as:
-//
-// match priority < 0:
-//    No match.
+// MatchesPositionSet is not in anonymous namespace to allow testing.
 //
-// match priority == 0:
-//    Match, but treat it as if matched an empty pattern.
-//
-// match priority > 0:
-//    Match.
-class RobotsMatchStrategy {
- public:
-  virtual ~RobotsMatchStrategy() = default;
-
-  virtual int MatchAllow(absl::string_view path,
-                         absl::string_view pattern) = 0;
-  virtual int MatchDisallow(absl::string_view path,
-                            absl::string_view pattern) = 0;
-
- protected:
-  // Implements robots.txt pattern matching.
-  static bool Matches(absl::string_view path, absl::string_view pattern);
-};
-
 // Returns true if URI path matches the specified pattern. Pattern is anchored
 // at the beginning of path. '$' is special only at the end of pattern.
 //
-// Since 'path' and 'pattern' are both externally determined (by the webmaster),
-// we make sure to have acceptable worst-case performance.
-/* static */ bool RobotsMatchStrategy::Matches(
-    absl::string_view path, absl::string_view pattern) {
+// This is the general matcher, with O(path * pattern) worst-case time. Unlike
+// MatchesBitParallel(), it has no limit on the length of the pattern.
+bool MatchesPositionSet(absl::string_view path, absl::string_view pattern) {
   const size_t pathlen = path.length();
   absl::FixedArray<size_t> pos(pathlen + 1);
   int numpos;
@@ -117,6 +105,158 @@ class RobotsMatchStrategy {
   return true;
 }
 
+namespace {
+
+// Builds the Shift-And automaton of 'pattern', the part of a WILDCARD pattern
+// from its first '*' on, without a trailing '$'. Bit i of a state is set when
+// the first i characters of 'pattern' other than '*' can match the part of the
+// path read so far. masks[classes[c]] has bit i+1 set if the i-th such
+// character is c, and bit i of 'self_loops' is set if a '*' follows it, which
+// lets the bit stay set on any input.
+//
+// 'classes' must be zeroed, 'masks' must have room for
+// WildcardPattern::kMaxChars + 1 classes. Returns the number of classes.
+int BuildShiftAnd(absl::string_view pattern, uint8_t* classes, uint64_t* masks,
+                  uint64_t* self_loops, uint64_t* accept) {
+  // Class 0 is that of the characters not in the pattern.
+  masks[0] = 0;
+  int num_classes = 1;
+  int num_chars = 0;
+  *self_loops = 0;
+  for (const char pattern_char : pattern) {
+    if (pattern_char == '*') {
+      *self_loops |= uint64_t{1} << num_chars;
+      continue;
+    }
+    ABSL_ASSERT(num_chars < WildcardPattern::kMaxChars);
+    uint8_t& char_class = classes[static_cast<unsigned char>(pattern_char)];
+    if (char_class == 0) {
+      char_class = num_classes;
+      masks[num_classes++] = 0;
+    }
+    masks[char_class] |= uint64_t{2} << num_chars;
+    ++num_chars;
+  }
+  *accept = uint64_t{1} << num_chars;
+  return num_classes;
+}
+
+// Returns true if the automaton built by BuildShiftAnd() matches 'path'.
+bool RunShiftAnd(absl::string_view path, const uint8_t* classes,
+                 const uint64_t* masks, uint64_t self_loops, uint64_t accept,
+                 bool anchored_at_end) {
+  // Without '$' the pattern only needs to match a prefix of 'path'.
+  if (!anchored_at_end && accept == 1) return true;
+  uint64_t state = 1;
+  for (const unsigned char c : path) {
+    state = ((state << 1) & masks[classes[c]]) | (state & self_loops);
+    if (state == 0) return false;
+    if (!anchored_at_end && (state & accept)) return true;
+  }
+  return (state & accept) != 0;
+}
+
+}  // namespace
+
+// MatchesBitParallel is not in anonymous namespace to allow testing.
+//
+// Same as MatchesPositionSet(), for patterns that WildcardPattern::Fits(). The
+// automaton is built on the stack for this one call, see WildcardPattern for
+// patterns matched against many paths.
+bool MatchesBitParallel(absl::string_view path, absl::string_view pattern) {
+  const bool anchored_at_end = absl::ConsumeSuffix(&pattern, "$");
+
+  // Patterns nearly always start with a literal part, which rules out most
+  // paths before the automaton needs to be set up.
+  const size_t literal_len = std::min(pattern.find('*'), pattern.size());
+  if (!absl::ConsumePrefix(&path, pattern.substr(0, literal_len))) {
+    return false;
+  }
+  if (literal_len == pattern.size()) {
+    return !anchored_at_end || path.empty();
+  }
+  pattern.remove_prefix(literal_len);
+
+  uint8_t classes[256] = {};
+  uint64_t masks[WildcardPattern::kMaxChars + 1];
+  uint64_t self_loops;
+  uint64_t accept;
+  BuildShiftAnd(pattern, classes, masks, &self_loops, &accept);
+  return RunShiftAnd(path, classes, masks, self_loops, accept, anchored_at_end);
+}
+
+/*static*/ bool WildcardPattern::Fits(absl::string_view pattern) {
+  absl::ConsumeSuffix(&pattern, "$");
+  // The literal prefix is compared as is, only the rest is in the automaton.
+  const size_t first_wildcard = pattern.find('*');
+  if (first_wildcard == absl::string_view::npos) return true;
+  int num_chars = 0;
+  for (const char pattern_char : pattern.substr(first_wildcard)) {
+    if (pattern_char != '*') ++num_chars;
+  }
+  return num_chars <= kMaxChars;
+}
+
+WildcardPattern::WildcardPattern(absl::string_view pattern) {
+  anchored_at_end_ = absl::ConsumeSuffix(&pattern, "$");
+  const size_t literal_len = std::min(pattern.find('*'), pattern.size());
+  prefix_ = std::string(pattern.substr(0, literal_len));
+  pattern.remove_prefix(literal_len);
+  uint64_t masks[kMaxChars + 1];
+  const int num_classes =
+      BuildShiftAnd(pattern, classes_, masks, &self_loops_, &accept_);
+  masks_.assign(masks, masks + num_classes);
+}
+
+bool WildcardPattern::Matches(absl::string_view path) const {
+  return absl::ConsumePrefix(&path, prefix_) &&
+         RunShiftAnd(path, classes_, masks_.data(), self_loops_, accept_,
+                     anchored_at_end_);
+}
+
+size_t WildcardPattern::MemoryUsage() const {
+  return sizeof(*this) + prefix_.capacity() +
+         masks_.capacity() * sizeof(masks_[0]);
+}
+
+PatternKind GetPatternKind(absl::string_view pattern) {
+  if (pattern.find('*') != absl::string_view::npos) {
+    return PatternKind::WILDCARD;
+  }
+  if (!pattern.empty() && pattern.back() == '$') {
+    return PatternKind::LITERAL_END_ANCHORED;
+  }
+  return PatternKind::LITERAL;
+}
+
+// Returns true if URI path matches the specified pattern. Pattern is anchored
+// at the beginning of path. '$' is special only at the end of pattern.
+//
+// Since 'path' and 'pattern' are both externally determined (by the webmaster),
+// we make sure to have acceptable worst-case performance.
+/* static */ bool RobotsMatchStrategy::Matches(
+    absl::string_view path, absl::string_view pattern) {
+  return Matches(path, pattern, GetPatternKind(pattern));
+}
+
+/* static */ bool RobotsMatchStrategy::Matches(absl::string_view path,
+                                               absl::string_view pattern,
+                                               PatternKind kind) {
+  switch (kind) {
+    case PatternKind::LITERAL:
+      return path.size() >= pattern.size() &&
+             memcmp(path.data(), pattern.data(), pattern.size()) == 0;
+    case PatternKind::LITERAL_END_ANCHORED:
+      pattern.remove_suffix(1);
+      return path.size() == pattern.size() &&
+             memcmp(path.data(), pattern.data(), pattern.size()) == 0;
+    case PatternKind::WILDCARD:
+      break;
+  }
+  if (WildcardPattern::Fits(pattern)) return MatchesBitParallel(path, pattern);
+  return MatchesPositionSet(path, pattern);
+}
+
 static const char* kHexDigits = "0123456789ABCDEF";
 
 // GetPathParamsQuery is not in anonymous namespace to allow testing.
@@ -124,7 +264,11 @@ static const char* kHexDigits = "0123456789ABCDEF";
 // Extracts path (with params) and query part from URL. Removes scheme,
 // authority, and fragment. Result always starts with "/".
 // Returns "/" if the url doesn't have a path or is not valid.
-std::string GetPathParamsQuery(const std::string& url) {
+//
+// The result points into 'url', or into 'buffer' if a slash needs to be
+// prepended, so that no allocation is needed in the common case.
+absl::string_view GetPathParamsQuery(absl::string_view url,
+                                     std::string* buffer) {
   // Initial two slashes are ignored.
   size_t search_start = 0;
   if (url.size() >= 2 && url[0] == '/' && url[1] == '/') search_start = 2;
@@ -133,29 +277,39 @@ std::string GetPathParamsQuery(const std::string& url) {
   size_t protocol_end = url.find("://", search_start);
   if (early_path < protocol_end) {
     // If path, param or query starts before ://, :// doesn't indicate protocol.
-    protocol_end = std::string::npos;
+    protocol_end = absl::string_view::npos;
   }
-  if (protocol_end == std::string::npos) {
+  if (protocol_end == absl::string_view::npos) {
     protocol_end = search_start;
   } else {
     protocol_end += 3;
   }
 
   size_t path_start = url.find_first_of("/?;", protocol_end);
-  if (path_start != std::string::npos) {
+  if (path_start != absl::string_view::npos) {
     size_t hash_pos = url.find('#', search_start);
     if (hash_pos < path_start) return "/";
-    size_t path_end = (hash_pos == std::string::npos) ? url.size() : hash_pos;
+    size_t path_end =
+        (hash_pos == absl::string_view::npos) ? url.size() : hash_pos;
+    const absl::string_view path =
+        url.substr(path_start, path_end - path_start);
     if (url[path_start] != '/') {
       // Prepend a slash if the result would start e.g. with '?'.
-      return "/" + url.substr(path_start, path_end - path_start);
+      buffer->assign("/");
+      buffer->append(path.data(), path.size());
+      return *buffer;
     }
-    return url.substr(path_start, path_end - path_start);
+    return path;
   }
 
   return "/";
 }
 
+std::string GetPathParamsQuery(const std::string& url) {
+  std::string buffer;
+  return std::string(GetPathParamsQuery(url, &buffer));
+}
+
 // MaybeEscapePattern is not in anonymous namespace to allow testing.
 //
 // Canonicalize the allowed/disallowed paths. For example:
@@ -163,16 +317,21 @@ std::string GetPathParamsQuery(const std::string& url) {
 //     %aa ==> %AA
 // When the function returns, (*dst) either points to src, or is newly
 // allocated.
-// Returns true if dst was newly allocated.
-bool MaybeEscapePattern(const char* src, char** dst) {
+// Returns 'src', or the escaped pattern written to 'buffer' if changes were
+// needed. Reusing 'buffer' across calls avoids allocating for every pattern.
+absl::string_view MaybeEscapePattern(absl::string_view src,
+                                     std::string* buffer) {
+  const auto is_escape_sequence = [src](size_t i) {
+    return src[i] == '%' && i + 2 < src.size() &&
+           absl::ascii_isxdigit(src[i + 1]) && absl::ascii_isxdigit(src[i + 2]);
+  };
   int num_to_escape = 0;
   bool need_capitalize = false;
 
   // First, scan the buffer to see if changes are needed. Most don't.
-  for (int i = 0; src[i] != 0; i++) {
+  for (size_t i = 0; i < src.size(); i++) {
     // (a) % escape sequence.
-    if (src[i] == '%' &&
-        absl::ascii_isxdigit(src[i+1]) && absl::ascii_isxdigit(src[i+2])) {
+    if (is_escape_sequence(i)) {
       if (absl::ascii_islower(src[i+1]) || absl::ascii_islower(src[i+2])) {
         need_capitalize = true;
       }
@@ -185,100 +344,215 @@ bool MaybeEscapePattern(const char* src, char** dst) {
   }
   // Return if no changes needed.
   if (!num_to_escape && !need_capitalize) {
-    (*dst) = const_cast<char*>(src);
-    return false;
+    return src;
   }
-  (*dst) = new char[num_to_escape * 2 + strlen(src) + 1];
-  int j = 0;
-  for (int i = 0; src[i] != 0; i++) {
+  buffer->clear();
+  buffer->reserve(num_to_escape * 2 + src.size());
+  for (size_t i = 0; i < src.size(); i++) {
     // (a) Normalize %-escaped sequence (eg. %2f -> %2F).
-    if (src[i] == '%' &&
-        absl::ascii_isxdigit(src[i+1]) && absl::ascii_isxdigit(src[i+2])) {
-      (*dst)[j++] = src[i++];
-      (*dst)[j++] = absl::ascii_toupper(src[i++]);
-      (*dst)[j++] = absl::ascii_toupper(src[i]);
+    if (is_escape_sequence(i)) {
+      buffer->push_back(src[i++]);
+      buffer->push_back(absl::ascii_toupper(src[i++]));
+      buffer->push_back(absl::ascii_toupper(src[i]));
       // (b) %-escape octets whose highest bit is set. These are outside the
       // ASCII range.
     } else if (src[i] & 0x80) {
-      (*dst)[j++] = '%';
-      (*dst)[j++] = kHexDigits[(src[i] >> 4) & 0xf];
-      (*dst)[j++] = kHexDigits[src[i] & 0xf];
+      buffer->push_back('%');
+      buffer->push_back(kHexDigits[(src[i] >> 4) & 0xf]);
+      buffer->push_back(kHexDigits[src[i] & 0xf]);
     // (c) Normal character, no modification needed.
     } else {
-      (*dst)[j++] = src[i];
+      buffer->push_back(src[i]);
     }
   }
-  (*dst)[j] = 0;
-  return true;
+  return *buffer;
 }
 
-// Internal helper classes and functions.
-namespace {
-static bool KeyIsUserAgent(absl::string_view key, bool* is_acceptable_typo) {
-  if (kAllowFrequentTypos) {
-    *is_acceptable_typo = (absl::StartsWithIgnoreCase(key, "useragent") ||
-                           absl::StartsWithIgnoreCase(key, "user agent"));
-  } else {
-    *is_acceptable_typo = false;
+// Returns true if dst was newly allocated.
+bool MaybeEscapePattern(const char* src, char** dst) {
+  std::string buffer;
+  const absl::string_view escaped = MaybeEscapePattern(src, &buffer);
+  if (escaped.data() == src) {
+    (*dst) = const_cast<char*>(src);
+    return false;
   }
-  return (absl::StartsWithIgnoreCase(key, "user-agent") || *is_acceptable_typo);
+  (*dst) = new char[escaped.size() + 1];
+  memcpy(*dst, escaped.data(), escaped.size());
+  (*dst)[escaped.size()] = 0;
+  return true;
 }
 
-static bool KeyIsAllow(absl::string_view key, bool* is_acceptable_typo) {
-  // We don't support typos for the "allow" key.
-  *is_acceptable_typo = false;
-  return absl::StartsWithIgnoreCase(key, "allow");
+// FindLineEnd is not in anonymous namespace to allow testing.
+//
+// Returns a pointer to the first '\n' or '\r' in [begin, end), or 'end' if
+// there is none. Scans 32 or 16 bytes at a time where AVX2 or SSE2 is
+// available.
+const char* FindLineEnd(const char* begin, const char* end) {
+  const char* pos = begin;
+#if defined(__AVX2__)
+  const __m256i lf32 = _mm256_set1_epi8('\n');
+  const __m256i cr32 = _mm256_set1_epi8('\r');
+  for (; end - pos >= 32; pos += 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+    const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf32),
+                        _mm256_cmpeq_epi8(chunk, cr32))));
+    if (mask != 0) return pos + __builtin_ctz(mask);
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i lf16 = _mm_set1_epi8('\n');
+  const __m128i cr16 = _mm_set1_epi8('\r');
+  for (; end - pos >= 16; pos += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+    const uint32_t mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, lf16),
+                                       _mm_cmpeq_epi8(chunk, cr16))));
+    if (mask != 0) return pos + __builtin_ctz(mask);
+  }
+#endif
+  for (; pos < end; ++pos) {
+    if (*pos == '\n' || *pos == '\r') return pos;
+  }
+  return end;
 }
 
-static bool KeyIsDisallow(absl::string_view key, bool* is_acceptable_typo) {
-  if (kAllowFrequentTypos) {
-    *is_acceptable_typo = (absl::StartsWithIgnoreCase(key, "dissallow") ||
-                           absl::StartsWithIgnoreCase(key, "dissalow") ||
-                           absl::StartsWithIgnoreCase(key, "disalow") ||
-                           absl::StartsWithIgnoreCase(key, "diasllow") ||
-                           absl::StartsWithIgnoreCase(key, "disallaw"));
-  } else {
-    *is_acceptable_typo = false;
+// Internal helper classes and functions.
+namespace {
+// A spelling of a directive key. Keys only have to start with one of these.
+struct KeySpelling {
+  absl::string_view prefix;
+  bool is_typo;
+};
+
+// The accepted spellings of each key, including frequent typos. The keys of
+// the supported directives all start with a different letter.
+constexpr KeySpelling kUserAgentSpellings[] = {
+    {"user-agent", false}, {"useragent", true}, {"user agent", true}};
+// We don't support typos for the "allow" key.
+constexpr KeySpelling kAllowSpellings[] = {{"allow", false}};
+constexpr KeySpelling kDisallowSpellings[] = {
+    {"disallow", false}, {"dissallow", true}, {"dissalow", true},
+    {"disalow", true},   {"diasllow", true},  {"disallaw", true}};
+constexpr KeySpelling kSitemapSpellings[] = {
+    {"sitemap", false}, {"site-map", true}};
+
+// Returns true if 'key' starts with one of the 'spellings', setting
+// 'is_acceptable_typo' if that spelling is a typo.
+template <size_t N>
+bool KeyHasSpelling(absl::string_view key, const KeySpelling (&spellings)[N],
+                    bool* is_acceptable_typo) {
+  for (const KeySpelling& spelling : spellings) {
+    if (spelling.is_typo && !kAllowFrequentTypos) continue;
+    if (absl::StartsWithIgnoreCase(key, spelling.prefix)) {
+      *is_acceptable_typo = spelling.is_typo;
+      return true;
+    }
   }
-  return (absl::StartsWithIgnoreCase(key, "disallow") || *is_acceptable_typo);
+  return false;
 }
 
-static bool KeyIsSitemap(absl::string_view key, bool* is_acceptable_typo) {
-  if (kAllowFrequentTypos) {
-    *is_acceptable_typo = absl::StartsWithIgnoreCase(key, "site-map");
-  } else {
-    *is_acceptable_typo = false;
+// Certain browsers limit the URL length to 2083 bytes. In a robots.txt, it's
+// fairly safe to assume any valid line isn't going to be more than many times
+// that max url length of 2KB. We want some padding for
+// UTF-8 encoding/nulls/etc. but a much smaller bound would be okay as well.
+// If so, we can ignore the chars on a line past that.
+const int kBrowserMaxLineLen = 2083;
+const int kMaxLineLen = kBrowserMaxLineLen * 8;
+// The number of chars of a line that are looked at. This used to be the
+// size of a buffer lines were copied into, which kept room for a final '\0'.
+const size_t kMaxLineChars = kMaxLineLen - 1;
+
+// UTF-8 byte order marks.
+const unsigned char kUtfBom[3] = {0xEF, 0xBB, 0xBF};
+
+// Returns the length of the longest prefix of 'data' that is also a prefix of
+// the UTF-8 byte order mark.
+size_t ByteOrderMarkPrefixLength(absl::string_view data) {
+  size_t length = 0;
+  while (length < sizeof(kUtfBom) && length < data.size() &&
+         static_cast<unsigned char>(data[length]) == kUtfBom[length]) {
+    ++length;
   }
-  return absl::StartsWithIgnoreCase(key, "sitemap") || *is_acceptable_typo;
+  return length;
 }
 
+}  // end anonymous namespace
+
+// RobotsTxtParser is not in anonymous namespace, so that RobotsTxtStreamParser
+// can keep one across calls.
 class RobotsTxtParser {
  public:
-  RobotsTxtParser(absl::string_view robots_body,
-                  RobotsParseHandler* handler)
-      : robots_body_(robots_body), handler_(handler) {
-  }
-
-  void Parse();
+  RobotsTxtParser(RobotsParseHandler* handler, RobotsParseContext* context,
+                  const RobotsParseLimits& limits)
+      : handler_(handler),
+        escaped_value_(&context->escaped_value_),
+        limits_(limits) {}
+
+  // Parses a whole robots.txt body.
+  void Parse(absl::string_view robots_body);
+
+  // Parsing can also be split across calls, for a body that arrives in
+  // chunks: Start(), then ApplyByteLimit() and SkipByteOrderMark() on each
+  // chunk and EndLine() for each line as they arrive, then Finish().
+  void Start();
+  // Returns the part of 'data' within the byte limit.
+  absl::string_view ApplyByteLimit(absl::string_view data);
+  // Returns 'data' without the part of the UTF-8 byte order mark that starts
+  // the body, if any. Does nothing once past the start of the body.
+  absl::string_view SkipByteOrderMark(absl::string_view data);
+  // Handles the line 'line' ended by the character 'line_ending'.
+  void EndLine(absl::string_view line, char line_ending);
+  // Handles the last line, which has no line ending, and ends the parse.
+  void Finish(absl::string_view last_line);
+
+  // Parses a part of a body that starts at the beginning of line
+  // 'first_line_num' and ends with a line ending or at the end of the body,
+  // without starting or ending the parse. Used to parse only some groups.
+  void ParseLines(absl::string_view lines, int first_line_num);
+
+  // Returns true once a limit made parsing stop. Lines are ignored from then.
+  bool stopped() const { return stopped_; }
+  const RobotsParseReport& report() const { return report_; }
 
  private:
   // Note that `key` and `value` are only set when `metadata->has_directive
   // == true`.
-  static void GetKeyAndValueFrom(char** key, char** value, char* line,
+  static void GetKeyAndValueFrom(absl::string_view* key,
+                                 absl::string_view* value,
+                                 absl::string_view line,
                                  RobotsParseHandler::LineMetadata* metadata);
-  static void StripWhitespaceSlowly(char ** s);
 
   static void EmitKeyValueToHandler(int line, KeyType key_type,
                                     absl::string_view key,
                                     absl::string_view value,
                                     RobotsParseHandler* handler);
 
-  void ParseAndEmitLine(int current_line, char* line,
-                        bool* line_too_long_strict);
+  // Parses 'line', not including the line ending.
+  void ParseAndEmitLine(int current_line, absl::string_view line);
   static bool NeedEscapeValueForKey(KeyType key_type);
 
-  absl::string_view robots_body_;
+  // Return false, and stop parsing, if another line or a directive of type
+  // 'key_type' would exceed the limits.
+  bool CanParseLine();
+  bool CanParseDirective(KeyType key_type);
+
   RobotsParseHandler* const handler_;
+  std::string* const escaped_value_;
+  int line_num_ = 0;
+  bool last_was_carriage_return_ = false;
+  // Number of bytes of the UTF-8 byte order mark seen at the start of the
+  // body, or its length once past the start.
+  size_t bom_pos_ = 0;
+
+  const RobotsParseLimits limits_;
+  RobotsParseReport report_;
+  bool stopped_ = false;
+  size_t bytes_seen_ = 0;
+  // Number of rules since the last user-agent line.
+  int rules_in_group_ = 0;
 };
 
 bool RobotsTxtParser::NeedEscapeValueForKey(KeyType key_type) {
@@ -291,25 +565,18 @@ bool RobotsTxtParser::NeedEscapeValueForKey(KeyType key_type) {
   }
 }
 
-// Removes leading and trailing whitespace from null-terminated string s.
-/* static */ void RobotsTxtParser::StripWhitespaceSlowly(char ** s) {
-  absl::string_view stripped = absl::StripAsciiWhitespace(*s);
-  *s = const_cast<char*>(stripped.data());
-  (*s)[stripped.size()] = '\0';
-}
-
 void RobotsTxtParser::GetKeyAndValueFrom(
-    char** key, char** value, char* line,
+    absl::string_view* key, absl::string_view* value, absl::string_view line,
     RobotsParseHandler::LineMetadata* metadata) {
   // Remove comments from the current robots.txt line.
-  char* const comment = strchr(line, '#');
-  if (nullptr != comment) {
+  const size_t comment = line.find('#');
+  if (comment != absl::string_view::npos) {
     metadata->has_comment = true;
-    *comment = '\0';
+    line = line.substr(0, comment);
   }
-  StripWhitespaceSlowly(&line);
+  line = absl::StripAsciiWhitespace(line);
   // If the line became empty after removing the comment, return.
-  if (strlen(line) == 0) {
+  if (line.empty()) {
     if (metadata->has_comment) {
       metadata->is_comment = true;
     } else {
@@ -320,16 +587,17 @@ void RobotsTxtParser::GetKeyAndValueFrom(
 
   // Rules must match the following pattern:
   //   <key>[ \t]*:[ \t]*<value>
-  char* sep = strchr(line, ':');
-  if (nullptr == sep) {
+  size_t sep = line.find(':');
+  if (sep == absl::string_view::npos) {
     // Google-specific optimization: some people forget the colon, so we need to
     // accept whitespace in its stead.
     static const char * const kWhite = " \t";
-    sep = strpbrk(line, kWhite);
-    if (nullptr != sep) {
-      const char* const val = sep + strspn(sep, kWhite);
-      assert(*val);  // since we dropped trailing whitespace above.
-      if (nullptr != strpbrk(val, kWhite)) {
+    sep = line.find_first_of(kWhite);
+    if (sep != absl::string_view::npos) {
+      const size_t val = line.find_first_not_of(kWhite, sep);
+      // Since we dropped trailing whitespace above.
+      assert(val != absl::string_view::npos);
+      if (line.find_first_of(kWhite, val) != absl::string_view::npos) {
         // We only accept whitespace as a separator if there are exactly two
         // sequences of non-whitespace characters.  If we get here, there were
         // more than 2 such sequences since we stripped trailing whitespace
@@ -339,17 +607,17 @@ void RobotsTxtParser::GetKeyAndValueFrom(
       metadata->is_missing_colon_separator = true;
     }
   }
-  if (nullptr == sep) {
+  if (sep == absl::string_view::npos) {
     return;  // Couldn't find a separator.
   }
 
-  *key = line;                        // Key starts at beginning of line.
-  *sep = '\0';                        // And stops at the separator.
-  StripWhitespaceSlowly(key);         // Get rid of any trailing whitespace.
+  // Key starts at beginning of line and stops at the separator. Get rid of
+  // any trailing whitespace.
+  *key = absl::StripTrailingAsciiWhitespace(line.substr(0, sep));
 
-  if ((*key)[0] != '\0') {
-    *value = 1 + sep;                 // Value starts after the separator.
-    StripWhitespaceSlowly(value);     // Get rid of any leading whitespace.
+  if (!key->empty()) {
+    // Value starts after the separator. Get rid of any leading whitespace.
+    *value = absl::StripLeadingAsciiWhitespace(line.substr(sep + 1));
     metadata->has_directive = true;
     return;
   }
@@ -378,27 +646,37 @@ void RobotsTxtParser::EmitKeyValueToHandler(int line, KeyType key_type,
   }
 }
 
-void RobotsTxtParser::ParseAndEmitLine(int current_line, char* line,
-                                       bool* line_too_long_strict) {
-  char* string_key;
-  char* value;
+void RobotsTxtParser::ParseAndEmitLine(int current_line,
+                                       absl::string_view line) {
   RobotsParseHandler::LineMetadata line_metadata;
-  // Note that `string_key` and `value` are only set when
+  // We can ignore the chars on a line past kMaxLineChars, and past a '\0'.
+  if (line.size() > kMaxLineChars) {
+    line = line.substr(0, kMaxLineChars);
+    line_metadata.is_line_too_long = true;
+  }
+  const void* const nul = memchr(line.data(), '\0', line.size());
+  if (nul != nullptr) {
+    line = line.substr(0, static_cast<const char*>(nul) - line.data());
+  }
+
+  absl::string_view key;
+  absl::string_view value;
+  // Note that `key` and `value` are only set when
   // `line_metadata->has_directive == true`.
-  GetKeyAndValueFrom(&string_key, &value, line, &line_metadata);
-  line_metadata.is_line_too_long = *line_too_long_strict;
+  GetKeyAndValueFrom(&key, &value, line, &line_metadata);
   if (!line_metadata.has_directive) {
+    report_.lines = current_line;
     handler_->ReportLineMetadata(current_line, line_metadata);
     return;
   }
-  absl::string_view key(string_key);
   KeyType key_type = GetKeyType(key, &line_metadata.is_acceptable_typo);
+  if (!CanParseDirective(key_type)) return;
+  report_.lines = current_line;
 
   if (NeedEscapeValueForKey(key_type)) {
-    char* escaped_value = nullptr;
-    const bool is_escaped = MaybeEscapePattern(value, &escaped_value);
+    const absl::string_view escaped_value =
+        MaybeEscapePattern(value, escaped_value_);
     EmitKeyValueToHandler(current_line, key_type, key, escaped_value, handler_);
-    if (is_escaped) delete[] escaped_value;
   } else {
     EmitKeyValueToHandler(current_line, key_type, key, value, handler_);
   }
@@ -406,186 +684,451 @@ void RobotsTxtParser::ParseAndEmitLine(int current_line, char* line,
   handler_->ReportLineMetadata(current_line, line_metadata);
 }
 
-void RobotsTxtParser::Parse() {
-  // UTF-8 byte order marks.
-  static const unsigned char utf_bom[3] = {0xEF, 0xBB, 0xBF};
-
-  // Certain browsers limit the URL length to 2083 bytes. In a robots.txt, it's
-  // fairly safe to assume any valid line isn't going to be more than many times
-  // that max url length of 2KB. We want some padding for
-  // UTF-8 encoding/nulls/etc. but a much smaller bound would be okay as well.
-  // If so, we can ignore the chars on a line past that.
-  const int kBrowserMaxLineLen = 2083;
-  const int kMaxLineLen = kBrowserMaxLineLen * 8;
-  // Allocate a buffer used to process the current line.
-  char* const line_buffer = new char[kMaxLineLen];
-  // last_line_pos is the last writeable pos within the line array
-  // (only a final '\0' may go here).
-  const char* const line_buffer_end = line_buffer + kMaxLineLen - 1;
-  bool line_too_long_strict = false;
-  char* line_pos = line_buffer;
-  int line_num = 0;
-  size_t bom_pos = 0;
-  bool last_was_carriage_return = false;
-  handler_->HandleRobotsStart();
-
-      {
-        for (const unsigned char ch : robots_body_) {
-      ABSL_ASSERT(line_pos <= line_buffer_end);
-      // Google-specific optimization: UTF-8 byte order marks should never
-      // appear in a robots.txt file, but they do nevertheless. Skipping
-      // possible BOM-prefix in the first bytes of the input.
-      if (bom_pos < sizeof(utf_bom) && ch == utf_bom[bom_pos++]) {
-        continue;
-      }
-      bom_pos = sizeof(utf_bom);
-      if (ch != 0x0A && ch != 0x0D) {  // Non-line-ending char case.
-        // Put in next spot on current line, as long as there's room.
-        if (line_pos < line_buffer_end) {
-          *(line_pos++) = ch;
-        } else {
-          line_too_long_strict = true;
-        }
-      } else {                         // Line-ending character char case.
-        *line_pos = '\0';
-        // Only emit an empty line if this was not due to the second character
-        // of the DOS line-ending \r\n .
-        const bool is_CRLF_continuation =
-            (line_pos == line_buffer) && last_was_carriage_return && ch == 0x0A;
-        if (!is_CRLF_continuation) {
-          ParseAndEmitLine(++line_num, line_buffer, &line_too_long_strict);
-          line_too_long_strict = false;
-        }
-        line_pos = line_buffer;
-        last_was_carriage_return = (ch == 0x0D);
+bool RobotsTxtParser::CanParseLine() {
+  if (limits_.max_lines > 0 && line_num_ >= limits_.max_lines) {
+    report_.exceeded_max_lines = true;
+    stopped_ = true;
+  }
+  return !stopped_;
+}
+
+bool RobotsTxtParser::CanParseDirective(KeyType key_type) {
+  switch (key_type) {
+    case KeyType::USER_AGENT:
+      rules_in_group_ = 0;
+      return true;
+    case KeyType::ALLOW:
+    case KeyType::DISALLOW:
+      if (limits_.max_rules > 0 && report_.rules >= limits_.max_rules) {
+        report_.exceeded_max_rules = true;
+        stopped_ = true;
+      } else if (limits_.max_rules_per_group > 0 &&
+                 rules_in_group_ >= limits_.max_rules_per_group) {
+        report_.exceeded_max_rules_per_group = true;
+        stopped_ = true;
+      } else {
+        ++rules_in_group_;
+        ++report_.rules;
       }
+      return !stopped_;
+    default:
+      return true;
+  }
+}
+
+void RobotsTxtParser::Start() { handler_->HandleRobotsStart(); }
+
+absl::string_view RobotsTxtParser::ApplyByteLimit(absl::string_view data) {
+  if (limits_.max_bytes == 0) return data;
+  const size_t room = limits_.max_bytes - bytes_seen_;
+  if (data.size() > room) {
+    data = data.substr(0, room);
+    report_.exceeded_max_bytes = true;
+  }
+  bytes_seen_ += data.size();
+  return data;
+}
+
+absl::string_view RobotsTxtParser::SkipByteOrderMark(absl::string_view data) {
+  // Google-specific optimization: UTF-8 byte order marks should never
+  // appear in a robots.txt file, but they do nevertheless. Skipping
+  // possible BOM-prefix in the first bytes of the input.
+  while (bom_pos_ < sizeof(kUtfBom) && !data.empty()) {
+    if (static_cast<unsigned char>(data[0]) != kUtfBom[bom_pos_]) {
+      bom_pos_ = sizeof(kUtfBom);
+      break;
     }
+    data.remove_prefix(1);
+    ++bom_pos_;
+  }
+  return data;
+}
+
+void RobotsTxtParser::EndLine(absl::string_view line, char line_ending) {
+  if (stopped_) return;
+  // Only emit an empty line if this was not due to the second character
+  // of the DOS line-ending \r\n .
+  const bool is_CRLF_continuation =
+      line.empty() && last_was_carriage_return_ && line_ending == 0x0A;
+  if (!is_CRLF_continuation && CanParseLine()) {
+    ParseAndEmitLine(++line_num_, line);
+  }
+  last_was_carriage_return_ = (line_ending == 0x0D);
+}
+
+void RobotsTxtParser::Finish(absl::string_view last_line) {
+  // The last line is incomplete if the byte limit cut the body. An empty last
+  // line after a line ending doesn't count against the line limit.
+  const bool is_final_empty_line =
+      last_line.empty() && limits_.max_lines > 0 &&
+      line_num_ >= limits_.max_lines;
+  if (!stopped_ && !report_.exceeded_max_bytes && !is_final_empty_line &&
+      CanParseLine()) {
+    ParseAndEmitLine(++line_num_, last_line);
   }
-  *line_pos = '\0';
-  ParseAndEmitLine(++line_num, line_buffer, &line_too_long_strict);
   handler_->HandleRobotsEnd();
-  delete [] line_buffer;
 }
 
-// Implements the default robots.txt matching strategy. The maximum number of
-// characters matched by a pattern is returned as its match priority.
-class LongestMatchRobotsMatchStrategy : public RobotsMatchStrategy {
- public:
-  LongestMatchRobotsMatchStrategy() = default;
+void RobotsTxtParser::Parse(absl::string_view robots_body) {
+  Start();
+  robots_body = SkipByteOrderMark(ApplyByteLimit(robots_body));
+  const char* pos = robots_body.data();
+  const char* const end = pos + robots_body.size();
+  for (const char* line_end = FindLineEnd(pos, end);
+       line_end != end && !stopped_; line_end = FindLineEnd(pos, end)) {
+    EndLine(absl::string_view(pos, line_end - pos), *line_end);
+    pos = line_end + 1;
+  }
+  Finish(absl::string_view(pos, end - pos));
+}
 
-  // Disallow copying and assignment.
-  LongestMatchRobotsMatchStrategy(const LongestMatchRobotsMatchStrategy&) =
-      delete;
-  LongestMatchRobotsMatchStrategy& operator=(
-      const LongestMatchRobotsMatchStrategy&) = delete;
+void RobotsTxtParser::ParseLines(absl::string_view lines, int first_line_num) {
+  line_num_ = first_line_num - 1;
+  last_was_carriage_return_ = false;
+  const char* pos = lines.data();
+  const char* const end = pos + lines.size();
+  for (const char* line_end = FindLineEnd(pos, end);
+       line_end != end && !stopped_; line_end = FindLineEnd(pos, end)) {
+    EndLine(absl::string_view(pos, line_end - pos), *line_end);
+    pos = line_end + 1;
+  }
+  // The last line of the body, if it's in 'lines'.
+  if (pos != end && !stopped_ && CanParseLine()) {
+    ParseAndEmitLine(++line_num_, absl::string_view(pos, end - pos));
+  }
+}
 
-  int MatchAllow(absl::string_view path, absl::string_view pattern) override;
-  int MatchDisallow(absl::string_view path, absl::string_view pattern) override;
-};
-}  // end anonymous namespace
+// Google-specific optimization: a '*' followed by space and more characters
+// in a user-agent record is still regarded a global rule.
+static bool IsGlobalUserAgent(absl::string_view user_agent) {
+  return user_agent.length() >= 1 && user_agent[0] == '*' &&
+         (user_agent.length() == 1 || isspace(user_agent[1]));
+}
+
+// Google-specific optimization: 'index.htm' and 'index.html' are normalized
+// to '/'. If 'pattern' refers to an index file, returns the length of its
+// directory part (including the final slash), otherwise returns 0.
+static size_t IndexFileDirectoryLength(absl::string_view pattern) {
+  const size_t slash_pos = pattern.find_last_of('/');
+
+  if (slash_pos != absl::string_view::npos &&
+      absl::StartsWith(absl::ClippedSubstr(pattern, slash_pos),
+                       "/index.htm")) {
+    return slash_pos + 1;
+  }
+  return 0;
+}
 
 KeyType GetKeyType(absl::string_view key, bool* is_acceptable_typo) {
-  if (KeyIsUserAgent(key, is_acceptable_typo)) {
-    return KeyType::USER_AGENT;
+  *is_acceptable_typo = false;
+  if (key.empty()) return KeyType::UNKNOWN;
+  // Only the spellings of the key starting with the same letter can match.
+  switch (absl::ascii_tolower(key[0])) {
+    case 'u':
+      if (KeyHasSpelling(key, kUserAgentSpellings, is_acceptable_typo)) {
+        return KeyType::USER_AGENT;
+      }
+      break;
+    case 'a':
+      if (KeyHasSpelling(key, kAllowSpellings, is_acceptable_typo)) {
+        return KeyType::ALLOW;
+      }
+      break;
+    case 'd':
+      if (KeyHasSpelling(key, kDisallowSpellings, is_acceptable_typo)) {
+        return KeyType::DISALLOW;
+      }
+      break;
+    case 's':
+      if (KeyHasSpelling(key, kSitemapSpellings, is_acceptable_typo)) {
+        return KeyType::SITEMAP;
+      }
+      break;
   }
-  if (KeyIsAllow(key, is_acceptable_typo)) {
-    return KeyType::ALLOW;
+  return KeyType::UNKNOWN;
+}
+
+// FNV-1a hash of the lowercased 'user_agent'.
+static uint64_t HashUserAgent(absl::string_view user_agent) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char c : user_agent) {
+    hash ^= static_cast<unsigned char>(absl::ascii_tolower(c));
+    hash *= 0x100000001b3ULL;
   }
-  if (KeyIsDisallow(key, is_acceptable_typo)) {
-    return KeyType::DISALLOW;
+  return hash;
+}
+
+int UserAgentSet::Insert(absl::string_view user_agent) {
+  // Keep at least half of the slots empty, so that probes stay short.
+  if (2 * (members_.size() + 1) > slots_.size()) {
+    Rehash(std::max<size_t>(8, 2 * slots_.size()));
   }
-  if (KeyIsSitemap(key, is_acceptable_typo)) {
-    return KeyType::SITEMAP;
+  const size_t slot = FindSlot(user_agent);
+  if (slots_[slot] >= 0) return slots_[slot];
+  slots_[slot] = size();
+  members_.emplace_back(chars_.size(), user_agent.size());
+  for (const char c : user_agent) chars_.push_back(absl::ascii_tolower(c));
+  return slots_[slot];
+}
+
+int UserAgentSet::Find(absl::string_view user_agent) const {
+  if (slots_.empty()) return -1;
+  return slots_[FindSlot(user_agent)];
+}
+
+void UserAgentSet::Clear() {
+  chars_.clear();
+  members_.clear();
+  std::fill(slots_.begin(), slots_.end(), -1);
+}
+
+size_t UserAgentSet::MemoryUsage() const {
+  return chars_.capacity() + members_.capacity() * sizeof(members_[0]) +
+         slots_.capacity() * sizeof(slots_[0]);
+}
+
+size_t UserAgentSet::FindSlot(absl::string_view user_agent) const {
+  const size_t mask = slots_.size() - 1;
+  for (size_t slot = HashUserAgent(user_agent) & mask;;
+       slot = (slot + 1) & mask) {
+    const int index = slots_[slot];
+    if (index < 0 || absl::EqualsIgnoreCase(Member(index), user_agent)) {
+      return slot;
+    }
+  }
+}
+
+absl::string_view UserAgentSet::Member(int index) const {
+  return absl::string_view(chars_).substr(members_[index].first,
+                                          members_[index].second);
+}
+
+void UserAgentSet::Rehash(size_t num_slots) {
+  slots_.assign(num_slots, -1);
+  for (int index = 0; index < size(); ++index) {
+    slots_[FindSlot(Member(index))] = index;
   }
-  *is_acceptable_typo = false;
-  return KeyType::UNKNOWN;
+}
+
+RobotsParseContext::RobotsParseContext() = default;
+
+RobotsParseContext::~RobotsParseContext() = default;
+
+// Parses with a context kept by the calling thread.
+static RobotsParseReport ParseWithThreadContext(
+    absl::string_view robots_body, RobotsParseHandler* parse_callback,
+    const RobotsParseLimits& limits) {
+  thread_local RobotsParseContext context;
+  thread_local bool context_in_use = false;
+  if (context_in_use) {
+    // A handler is parsing another robots.txt from one of its callbacks.
+    RobotsParseContext nested_context;
+    return ParseRobotsTxt(robots_body, parse_callback, limits,
+                          &nested_context);
+  }
+  context_in_use = true;
+  const RobotsParseReport report =
+      ParseRobotsTxt(robots_body, parse_callback, limits, &context);
+  context_in_use = false;
+  return report;
 }
 
 void ParseRobotsTxt(absl::string_view robots_body,
                     RobotsParseHandler* parse_callback) {
-  RobotsTxtParser parser(robots_body, parse_callback);
-  parser.Parse();
+  ParseWithThreadContext(robots_body, parse_callback, RobotsParseLimits());
+}
+
+void ParseRobotsTxt(absl::string_view robots_body,
+                    RobotsParseHandler* parse_callback,
+                    RobotsParseContext* context) {
+  ParseRobotsTxt(robots_body, parse_callback, RobotsParseLimits(), context);
+}
+
+RobotsParseReport ParseRobotsTxt(absl::string_view robots_body,
+                                 RobotsParseHandler* parse_callback,
+                                 const RobotsParseLimits& limits,
+                                 RobotsParseContext* context) {
+  RobotsTxtParser parser(parse_callback, context, limits);
+  parser.Parse(robots_body);
+  return parser.report();
+}
+
+RobotsTxtStreamParser::RobotsTxtStreamParser(
+    RobotsParseHandler* parse_callback)
+    : RobotsTxtStreamParser(parse_callback, RobotsParseLimits()) {}
+
+RobotsTxtStreamParser::RobotsTxtStreamParser(
+    RobotsParseHandler* parse_callback, const RobotsParseLimits& limits)
+    : parser_(new RobotsTxtParser(parse_callback, &context_, limits)) {
+  parser_->Start();
+}
+
+RobotsTxtStreamParser::~RobotsTxtStreamParser() = default;
+
+void RobotsTxtStreamParser::Feed(absl::string_view chunk) {
+  ABSL_ASSERT(!finished_);
+  if (parser_->stopped()) return;
+  chunk = parser_->SkipByteOrderMark(parser_->ApplyByteLimit(chunk));
+  const char* pos = chunk.data();
+  const char* const end = pos + chunk.size();
+  for (const char* line_end = FindLineEnd(pos, end);
+       line_end != end && !parser_->stopped();
+       line_end = FindLineEnd(pos, end)) {
+    const absl::string_view line(pos, line_end - pos);
+    if (partial_line_.empty()) {
+      parser_->EndLine(line, *line_end);
+    } else {
+      // The line started in an earlier chunk.
+      AppendToPartialLine(line);
+      parser_->EndLine(partial_line_, *line_end);
+      partial_line_.clear();
+    }
+    pos = line_end + 1;
+  }
+  AppendToPartialLine(absl::string_view(pos, end - pos));
+}
+
+void RobotsTxtStreamParser::Finish() {
+  ABSL_ASSERT(!finished_);
+  finished_ = true;
+  parser_->Finish(partial_line_);
+  partial_line_.clear();
+}
+
+const RobotsParseReport& RobotsTxtStreamParser::report() const {
+  return parser_->report();
 }
 
-RobotsMatcher::RobotsMatcher()
+void RobotsTxtStreamParser::AppendToPartialLine(absl::string_view data) {
+  // Chars past kMaxLineChars are ignored, so there's no need to keep them.
+  // One more is kept to tell that the line is too long.
+  const size_t room = kMaxLineChars + 1 - partial_line_.size();
+  partial_line_.append(data.data(), std::min(data.size(), room));
+}
+
+RobotsMatcherBase::RobotsMatcherBase()
     : seen_global_agent_(false),
       seen_specific_agent_(false),
       ever_seen_specific_agent_(false),
-      seen_separator_(false),
-      path_(nullptr),
-      user_agents_(nullptr) {
-  match_strategy_ = new LongestMatchRobotsMatchStrategy();
-}
+      seen_separator_(false) {}
 
-RobotsMatcher::~RobotsMatcher() {
-  delete match_strategy_;
-}
+RobotsMatcherBase::~RobotsMatcherBase() = default;
 
-bool RobotsMatcher::ever_seen_specific_agent() const {
+bool RobotsMatcherBase::ever_seen_specific_agent() const {
   return ever_seen_specific_agent_;
 }
 
-void RobotsMatcher::InitUserAgentsAndPath(
+void RobotsMatcherBase::InitUserAgentsAndPath(
     const std::vector<std::string>* user_agents, const char* path) {
-  // The RobotsParser object doesn't own path_ or user_agents_, so overwriting
-  // these pointers doesn't cause a memory leak.
+  // Keep views of the user agents in a buffer reused across calls.
+  user_agent_views_.assign(user_agents->begin(), user_agents->end());
+  InitUserAgentsAndPath(user_agent_views_, path);
+}
+
+void RobotsMatcherBase::InitUserAgentsAndPath(
+    absl::Span<const absl::string_view> user_agents, absl::string_view path) {
+  // The RobotsParser object doesn't own path_, so overwriting this view
+  // doesn't cause a memory leak.
   path_ = path;
-  ABSL_ASSERT('/' == *path_);
-  user_agents_ = user_agents;
+  ABSL_ASSERT(!path_.empty() && '/' == path_[0]);
+  user_agent_set_.Clear();
+  for (const absl::string_view user_agent : user_agents) {
+    user_agent_set_.Insert(user_agent);
+  }
 }
 
-bool RobotsMatcher::AllowedByRobots(absl::string_view robots_body,
+bool RobotsMatcherBase::AllowedByRobots(absl::string_view robots_body,
                                     const std::vector<std::string>* user_agents,
-                                    const std::string& url) {
+                                    absl::string_view url) {
+  user_agent_views_.assign(user_agents->begin(), user_agents->end());
+  return AllowedByRobots(robots_body, user_agent_views_, url);
+}
+
+bool RobotsMatcherBase::AllowedByRobots(
+    absl::string_view robots_body,
+    absl::Span<const absl::string_view> user_agents, absl::string_view url) {
   // The url is not normalized (escaped, percent encoded) here because the user
   // is asked to provide it in escaped form already.
-  std::string path = GetPathParamsQuery(url);
-  InitUserAgentsAndPath(user_agents, path.c_str());
-  ParseRobotsTxt(robots_body, this);
+  const absl::string_view path = GetPathParamsQuery(url, &path_buffer_);
+  InitUserAgentsAndPath(user_agents, path);
+  ParseRobotsTxt(robots_body, this, &parse_context_);
   return !disallow();
 }
 
-bool RobotsMatcher::OneAgentAllowedByRobots(absl::string_view robots_txt,
-                                            const std::string& user_agent,
-                                            const std::string& url) {
-  std::vector<std::string> v;
-  v.push_back(user_agent);
-  return AllowedByRobots(robots_txt, &v, url);
+bool RobotsMatcherBase::OneAgentAllowedByRobots(absl::string_view robots_txt,
+                                            absl::string_view user_agent,
+                                            absl::string_view url) {
+  return AllowedByRobots(robots_txt, absl::MakeConstSpan(&user_agent, 1), url);
 }
 
-bool RobotsMatcher::disallow() const {
-  if (allow_.specific.priority() > 0 || disallow_.specific.priority() > 0) {
-    return (disallow_.specific.priority() > allow_.specific.priority());
+bool RobotsMatcherBase::AllowedByRobots(
+    const RobotsGroupIndex& robots,
+    absl::Span<const absl::string_view> user_agents, absl::string_view url) {
+  const absl::string_view path = GetPathParamsQuery(url, &path_buffer_);
+  InitUserAgentsAndPath(user_agents, path);
+  // Lines outside of the groups that apply don't change the outcome: rules
+  // are ignored unless a user-agent line of their group matched.
+  RobotsTxtParser parser(this, &parse_context_, RobotsParseLimits());
+  HandleRobotsStart();
+  for (const RobotsGroupIndex::Group& group : robots.groups_) {
+    if (RobotsGroupIndex::Applies(group, user_agent_set_)) {
+      parser.ParseLines(group.lines, group.first_line);
+    }
+  }
+  HandleRobotsEnd();
+  return !disallow();
+}
+
+bool RobotsMatcherBase::OneAgentAllowedByRobots(const RobotsGroupIndex& robots,
+                                            absl::string_view user_agent,
+                                            absl::string_view url) {
+  return AllowedByRobots(robots, absl::MakeConstSpan(&user_agent, 1), url);
+}
+
+bool RobotsMatcherBase::disallow() const {
+  return Disallow(allow_, disallow_, ever_seen_specific_agent_);
+}
+
+/*static*/ bool RobotsMatcherBase::Disallow(const MatchHierarchy& allow,
+                                        const MatchHierarchy& disallow,
+                                        bool ever_seen_specific_agent) {
+  if (allow.specific.priority() > 0 || disallow.specific.priority() > 0) {
+    return (disallow.specific.priority() > allow.specific.priority());
   }
 
-  if (ever_seen_specific_agent_) {
+  if (ever_seen_specific_agent) {
     // Matching group for user-agent but either without disallow or empty one,
     // i.e. priority == 0.
     return false;
   }
 
-  if (disallow_.global.priority() > 0 || allow_.global.priority() > 0) {
-    return disallow_.global.priority() > allow_.global.priority();
+  if (disallow.global.priority() > 0 || allow.global.priority() > 0) {
+    return disallow.global.priority() > allow.global.priority();
   }
   return false;
 }
 
-bool RobotsMatcher::disallow_ignore_global() const {
+bool RobotsMatcherBase::disallow_ignore_global() const {
   if (allow_.specific.priority() > 0 || disallow_.specific.priority() > 0) {
     return disallow_.specific.priority() > allow_.specific.priority();
   }
   return false;
 }
 
-int RobotsMatcher::matching_line() const {
-  if (ever_seen_specific_agent_) {
-    return Match::HigherPriorityMatch(disallow_.specific, allow_.specific)
-        .line();
+int RobotsMatcherBase::matching_line() const {
+  return MatchingLine(allow_, disallow_, ever_seen_specific_agent_);
+}
+
+/*static*/ int RobotsMatcherBase::MatchingLine(const MatchHierarchy& allow,
+                                           const MatchHierarchy& disallow,
+                                           bool ever_seen_specific_agent) {
+  if (ever_seen_specific_agent) {
+    return Match::HigherPriorityMatch(disallow.specific, allow.specific).line();
   }
-  return Match::HigherPriorityMatch(disallow_.global, allow_.global).line();
+  return Match::HigherPriorityMatch(disallow.global, allow.global).line();
 }
 
-void RobotsMatcher::HandleRobotsStart() {
+void RobotsMatcherBase::HandleRobotsStart() {
   // This is a new robots.txt file, so we need to reset all the instance member
   // variables. We do it in the same order the instance member variables are
   // declared, so it's easier to keep track of which ones we have (or maybe
@@ -599,107 +1142,1198 @@ void RobotsMatcher::HandleRobotsStart() {
   seen_separator_ = false;
 }
 
-/*static*/ absl::string_view RobotsMatcher::ExtractUserAgent(
+/*static*/ absl::string_view RobotsMatcherBase::ExtractUserAgent(
     absl::string_view user_agent) {
   // Allowed characters in user-agent are [a-zA-Z_-].
-  const char* end = user_agent.data();
-  while (absl::ascii_isalpha(*end) || *end == '-' || *end == '_') {
+  size_t end = 0;
+  while (end < user_agent.size() &&
+         (absl::ascii_isalpha(user_agent[end]) || user_agent[end] == '-' ||
+          user_agent[end] == '_')) {
     ++end;
   }
-  return user_agent.substr(0, end - user_agent.data());
+  return user_agent.substr(0, end);
 }
 
-/*static*/ bool RobotsMatcher::IsValidUserAgentToObey(
+/*static*/ bool RobotsMatcherBase::IsValidUserAgentToObey(
     absl::string_view user_agent) {
   return user_agent.length() > 0 && ExtractUserAgent(user_agent) == user_agent;
 }
 
-void RobotsMatcher::HandleUserAgent(int line_num,
+void RobotsMatcherBase::HandleUserAgent(int line_num,
                                     absl::string_view user_agent) {
   if (seen_separator_) {
     seen_specific_agent_ = seen_global_agent_ = seen_separator_ = false;
   }
 
-  // Google-specific optimization: a '*' followed by space and more characters
-  // in a user-agent record is still regarded a global rule.
-  if (user_agent.length() >= 1 && user_agent[0] == '*' &&
-      (user_agent.length() == 1 || isspace(user_agent[1]))) {
+  if (IsGlobalUserAgent(user_agent)) {
     seen_global_agent_ = true;
   } else {
-    user_agent = ExtractUserAgent(user_agent);
-    for (const auto& agent : *user_agents_) {
-      if (absl::EqualsIgnoreCase(user_agent, agent)) {
-        ever_seen_specific_agent_ = seen_specific_agent_ = true;
-        break;
+    if (user_agent_set_.Contains(ExtractUserAgent(user_agent))) {
+      ever_seen_specific_agent_ = seen_specific_agent_ = true;
+    }
+  }
+}
+
+void RobotsMatcherBase::RecordMatch(MatchHierarchy* matches, int line_num,
+                                    int priority) {
+  if (seen_specific_agent_) {
+    if (matches->specific.priority() < priority) {
+      matches->specific.Set(priority, line_num);
+    }
+  } else {
+    assert(seen_global_agent_);
+    if (matches->global.priority() < priority) {
+      matches->global.Set(priority, line_num);
+    }
+  }
+}
+
+void RobotsMatcherBase::HandleIndexFileAllow(int line_num,
+                                             absl::string_view value) {
+  // Google-specific optimization: 'index.htm' and 'index.html' are normalized
+  // to '/'.
+  const int len = IndexFileDirectoryLength(value);
+  if (len > 0) {
+    absl::FixedArray<char> newpattern(len + 1);
+    strncpy(newpattern.data(), value.data(), len);
+    newpattern[len] = '$';
+    HandleAllow(line_num,
+                absl::string_view(newpattern.data(), newpattern.size()));
+  }
+}
+
+template class BasicRobotsMatcher<LongestMatchRobotsMatchStrategy>;
+
+void RobotsMatcherBase::HandleSitemap(int line_num, absl::string_view value) {}
+
+void RobotsMatcherBase::HandleUnknownAction(int line_num, absl::string_view action,
+                                        absl::string_view value) {}
+
+// Collects the groups of a robots.txt into a CompiledRobots. Groups are split
+// the same way RobotsMatcher splits them: a user-agent line following any
+// Allow or Disallow line starts a new group.
+class CompiledRobots::Builder : public RobotsParseHandler {
+ public:
+  explicit Builder(std::vector<Group>* groups) : groups_(groups) {}
+
+  void HandleRobotsStart() override {
+    groups_->clear();
+    seen_separator_ = false;
+  }
+  void HandleRobotsEnd() override {
+    for (Group& group : *groups_) IndexGroup(&group);
+  }
+
+  void HandleUserAgent(int line_num, absl::string_view user_agent) override {
+    if (groups_->empty() || seen_separator_) {
+      groups_->emplace_back();
+      seen_separator_ = false;
+    }
+    Group& group = groups_->back();
+    if (IsGlobalUserAgent(user_agent)) {
+      group.is_global = true;
+    } else {
+      group.user_agents.emplace_back(
+          RobotsMatcher::ExtractUserAgent(user_agent));
+    }
+  }
+
+  void HandleAllow(int line_num, absl::string_view value) override {
+    if (groups_->empty()) return;
+    seen_separator_ = true;
+    std::vector<Rule>& rules = groups_->back().allow;
+    rules.emplace_back(std::string(value), line_num);
+    // RobotsMatcher::HandleAllow() only tries the directory pattern when the
+    // index file pattern doesn't match. The directory pattern is always
+    // shorter, so keeping it right after the original one gives the same
+    // longest match.
+    const size_t len = IndexFileDirectoryLength(value);
+    if (len > 0) {
+      rules.emplace_back(absl::StrCat(value.substr(0, len), "$"), line_num);
+    }
+  }
+
+  void HandleDisallow(int line_num, absl::string_view value) override {
+    if (groups_->empty()) return;
+    seen_separator_ = true;
+    groups_->back().disallow.emplace_back(std::string(value), line_num);
+  }
+
+  void HandleSitemap(int line_num, absl::string_view value) override {}
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {}
+
+ private:
+  std::vector<Group>* const groups_;
+  bool seen_separator_ = false;  // True if saw an Allow or Disallow line.
+};
+
+// Finds where the groups start, using the same rule as RobotsMatcher: a
+// user-agent line that follows an Allow or Disallow line starts a new group.
+class RobotsGroupIndex::Builder : public RobotsParseHandler {
+ public:
+  Builder(absl::string_view robots_body, std::vector<Group>* groups)
+      : robots_body_(robots_body), groups_(groups) {}
+
+  void HandleRobotsStart() override {}
+
+  void HandleRobotsEnd() override { EndGroup(robots_body_.end()); }
+
+  void HandleUserAgent(int line_num, absl::string_view user_agent) override {
+    if (groups_->empty() || seen_separator_) {
+      // User-agent values are never escaped, so they point into the body.
+      const char* const line_begin = LineBegin(user_agent.data());
+      EndGroup(line_begin);
+      groups_->emplace_back();
+      groups_->back().lines = absl::string_view(line_begin, 0);
+      groups_->back().first_line = line_num;
+      seen_separator_ = false;
+    }
+    Group& group = groups_->back();
+    if (IsGlobalUserAgent(user_agent)) {
+      group.is_global = true;
+    } else {
+      group.user_agents.emplace_back(
+          RobotsMatcher::ExtractUserAgent(user_agent));
+    }
+  }
+
+  void HandleAllow(int line_num, absl::string_view value) override {
+    if (!groups_->empty()) seen_separator_ = true;
+  }
+
+  void HandleDisallow(int line_num, absl::string_view value) override {
+    if (!groups_->empty()) seen_separator_ = true;
+  }
+
+  void HandleSitemap(int line_num, absl::string_view value) override {}
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {}
+
+ private:
+  // Returns the beginning of the line that 'pos' is on. The first line starts
+  // after the byte order mark, if any.
+  const char* LineBegin(const char* pos) const {
+    const char* const body_begin = robots_body_.data() + bom_length_;
+    while (pos > body_begin && pos[-1] != '\n' && pos[-1] != '\r') --pos;
+    return pos;
+  }
+
+  // Makes the last group span the lines up to 'end'.
+  void EndGroup(const char* end) {
+    if (groups_->empty()) return;
+    absl::string_view& lines = groups_->back().lines;
+    lines = absl::string_view(lines.data(), end - lines.data());
+  }
+
+  const absl::string_view robots_body_;
+  std::vector<Group>* const groups_;
+  const size_t bom_length_ = ByteOrderMarkPrefixLength(robots_body_);
+  bool seen_separator_ = false;
+};
+
+RobotsGroupIndex::RobotsGroupIndex(absl::string_view robots_body) {
+  Builder builder(robots_body, &groups_);
+  ParseRobotsTxt(robots_body, &builder);
+}
+
+/*static*/ bool RobotsGroupIndex::Applies(const Group& group,
+                                          const UserAgentSet& user_agents) {
+  if (group.is_global) return true;
+  for (const std::string& group_agent : group.user_agents) {
+    if (user_agents.Contains(group_agent)) return true;
+  }
+  return false;
+}
+
+CompiledRobots::CompiledRobots(absl::string_view robots_body)
+    : CompiledRobots(robots_body, RobotsParseLimits()) {}
+
+CompiledRobots::CompiledRobots(absl::string_view robots_body,
+                               const RobotsParseLimits& limits) {
+  Builder builder(&groups_);
+  parse_report_ = ParseWithThreadContext(robots_body, &builder, limits);
+  IndexUserAgents();
+}
+
+void CompiledRobots::IndexUserAgents() {
+  for (int i = 0; i < static_cast<int>(groups_.size()); ++i) {
+    const Group& group = groups_[i];
+    if (group.is_global) {
+      global_groups_.push_back(i);
+      global_summary_.Add(group.summary);
+    }
+    for (const std::string& user_agent : group.user_agents) {
+      const int index = group_user_agents_.Insert(user_agent);
+      if (index == static_cast<int>(groups_by_user_agent_.size())) {
+        groups_by_user_agent_.emplace_back();
+        summary_by_user_agent_.emplace_back();
+      }
+      std::vector<int>& groups = groups_by_user_agent_[index];
+      if (groups.empty() || groups.back() != i) {
+        groups.push_back(i);
+        summary_by_user_agent_[index].Add(group.summary);
       }
     }
   }
+
+  // User agents not named by the robots.txt get the global verdict.
+  allows_all_ = global_summary_.verdict() == HostVerdict::ALLOW_ALL;
+  disallows_all_ = global_summary_.verdict() == HostVerdict::DISALLOW_ALL;
+  for (const RuleSummary& summary : summary_by_user_agent_) {
+    allows_all_ &= summary.verdict() == HostVerdict::ALLOW_ALL;
+    disallows_all_ &= summary.verdict() == HostVerdict::DISALLOW_ALL;
+  }
 }
 
-void RobotsMatcher::HandleAllow(int line_num, absl::string_view value) {
-  if (!seen_any_agent()) return;
-  seen_separator_ = true;
-  const int priority = match_strategy_->MatchAllow(path_, value);
-  if (priority >= 0) {
-    if (seen_specific_agent_) {
-      if (allow_.specific.priority() < priority) {
-        allow_.specific.Set(priority, line_num);
+size_t CompiledRobots::MemoryUsage() const {
+  size_t bytes = sizeof(*this) + groups_.capacity() * sizeof(Group);
+  for (const Group& group : groups_) {
+    bytes += group.user_agents.capacity() * sizeof(std::string);
+    for (const std::string& user_agent : group.user_agents) {
+      bytes += user_agent.capacity();
+    }
+    for (const std::vector<Rule>* rules : {&group.allow, &group.disallow}) {
+      bytes += rules->capacity() * sizeof(Rule);
+      for (const Rule& rule : *rules) {
+        bytes += rule.pattern.capacity();
+        if (rule.wildcard != nullptr) bytes += rule.wildcard->MemoryUsage();
       }
-    } else {
-      assert(seen_global_agent_);
-      if (allow_.global.priority() < priority) {
-        allow_.global.Set(priority, line_num);
+    }
+    bytes += group.literal_trie.capacity() * sizeof(TrieNode) +
+             (group.wildcard_allow.capacity() +
+              group.wildcard_disallow.capacity()) *
+                 sizeof(int);
+  }
+  bytes += group_user_agents_.MemoryUsage() +
+           groups_by_user_agent_.capacity() * sizeof(std::vector<int>) +
+           global_groups_.capacity() * sizeof(int) +
+           summary_by_user_agent_.capacity() * sizeof(RuleSummary);
+  for (const std::vector<int>& groups : groups_by_user_agent_) {
+    bytes += groups.capacity() * sizeof(int);
+  }
+  return bytes;
+}
+
+void CompiledRobots::RuleSummary::Add(const RuleSummary& other) {
+  has_allow |= other.has_allow;
+  has_disallow |= other.has_disallow;
+  disallows_all |= other.disallows_all;
+  decisive_length = std::max(decisive_length, other.decisive_length);
+}
+
+HostVerdict CompiledRobots::RuleSummary::verdict() const {
+  // Empty patterns match with priority 0, which never decides a verdict.
+  if (!has_disallow) return HostVerdict::ALLOW_ALL;
+  // Any path is disallowed with a priority of at least 1, and no Allow rule
+  // can match with a priority above 0.
+  if (disallows_all && !has_allow) return HostVerdict::DISALLOW_ALL;
+  return HostVerdict::PER_URL;
+}
+
+uint32_t CompiledRobots::RuleSummary::ToBits() const {
+  return (has_allow ? 1 : 0) | (has_disallow ? 2 : 0) | (disallows_all ? 4 : 0);
+}
+
+/*static*/ CompiledRobots::RuleSummary CompiledRobots::RuleSummary::FromBits(
+    uint32_t bits) {
+  RuleSummary summary;
+  summary.has_allow = (bits & 1) != 0;
+  summary.has_disallow = (bits & 2) != 0;
+  summary.disallows_all = (bits & 4) != 0;
+  return summary;
+}
+
+HostVerdict CompiledRobots::GetHostVerdict(absl::string_view user_agent) const {
+  return HostVerdictFor(absl::MakeConstSpan(&user_agent, 1));
+}
+
+HostVerdict CompiledRobots::GetHostVerdict(
+    const std::vector<std::string>& user_agents) const {
+  return HostVerdictFor(user_agents);
+}
+
+HostVerdict CompiledRobots::GetHostVerdict(
+    absl::Span<const absl::string_view> user_agents) const {
+  return HostVerdictFor(user_agents);
+}
+
+template <typename UserAgents>
+HostVerdict CompiledRobots::HostVerdictFor(
+    const UserAgents& user_agents) const {
+  if (allows_all_) return HostVerdict::ALLOW_ALL;
+  if (disallows_all_) return HostVerdict::DISALLOW_ALL;
+  // As for URLs, only the groups naming one of the user agents count if there
+  // are any.
+  RuleSummary summary;
+  bool ever_seen_specific_agent = false;
+  for (const auto& agent : user_agents) {
+    const int index = group_user_agents_.Find(agent);
+    if (index >= 0) {
+      summary.Add(summary_by_user_agent_[index]);
+      ever_seen_specific_agent = true;
+    }
+  }
+  return ever_seen_specific_agent ? summary.verdict()
+                                  : global_summary_.verdict();
+}
+
+int CompiledRobots::GetUserAgentId(absl::string_view user_agent) const {
+  return group_user_agents_.Find(user_agent);
+}
+
+bool CompiledRobots::GetDecisivePath(absl::string_view user_agent,
+                                     absl::string_view url,
+                                     std::string* buffer,
+                                     absl::string_view* decisive_path) const {
+  // As for URLs, only the groups naming the user agent count if there are
+  // any, otherwise only the global groups.
+  const int index = group_user_agents_.Find(user_agent);
+  const size_t length = index >= 0
+                            ? summary_by_user_agent_[index].decisive_length
+                            : global_summary_.decisive_length;
+  if (length == absl::string_view::npos) return false;
+  *decisive_path = GetPathParamsQuery(url, buffer).substr(0, length);
+  return true;
+}
+
+/*static*/ std::shared_ptr<const CompiledRobots> CompiledRobots::Create(
+    absl::string_view robots_body) {
+  return std::make_shared<const CompiledRobots>(robots_body);
+}
+
+/*static*/ std::shared_ptr<const CompiledRobots> CompiledRobots::Create(
+    absl::string_view robots_body, const RobotsParseLimits& limits) {
+  return std::make_shared<const CompiledRobots>(robots_body, limits);
+}
+
+bool CompiledRobots::IsAllowed(absl::string_view user_agent,
+                               absl::string_view url) const {
+  return AllowedByRobots(absl::MakeConstSpan(&user_agent, 1), url);
+}
+
+bool CompiledRobots::AllowedByRobots(
+    const std::vector<std::string>& user_agents, absl::string_view url) const {
+  const HostVerdict host_verdict = HostVerdictFor(user_agents);
+  if (host_verdict != HostVerdict::PER_URL) {
+    return host_verdict == HostVerdict::ALLOW_ALL;
+  }
+  return Evaluate(user_agents, url).allowed;
+}
+
+bool CompiledRobots::AllowedByRobots(
+    absl::Span<const absl::string_view> user_agents,
+    absl::string_view url) const {
+  const HostVerdict host_verdict = HostVerdictFor(user_agents);
+  if (host_verdict != HostVerdict::PER_URL) {
+    return host_verdict == HostVerdict::ALLOW_ALL;
+  }
+  return Evaluate(user_agents, url).allowed;
+}
+
+RobotsVerdict CompiledRobots::Evaluate(absl::string_view user_agent,
+                                       absl::string_view url) const {
+  return Evaluate(absl::MakeConstSpan(&user_agent, 1), url);
+}
+
+RobotsVerdict CompiledRobots::Evaluate(
+    const std::vector<std::string>& user_agents, absl::string_view url) const {
+  std::string path_buffer;
+  return EvaluatePath(user_agents, GetPathParamsQuery(url, &path_buffer));
+}
+
+RobotsVerdict CompiledRobots::Evaluate(
+    absl::Span<const absl::string_view> user_agents,
+    absl::string_view url) const {
+  std::string path_buffer;
+  return EvaluatePath(user_agents, GetPathParamsQuery(url, &path_buffer));
+}
+
+std::vector<RobotsVerdict> CompiledRobots::EvaluatePerAgent(
+    const std::vector<std::string>& user_agents, absl::string_view url) const {
+  std::string path_buffer;
+  const absl::string_view path = GetPathParamsQuery(url, &path_buffer);
+  // One separate set of matches per user agent.
+  std::vector<RobotsMatcher::MatchHierarchy> allow(user_agents.size());
+  std::vector<RobotsMatcher::MatchHierarchy> disallow(user_agents.size());
+  std::vector<bool> ever_seen_specific_agent(user_agents.size(), false);
+  std::vector<bool> is_specific(user_agents.size());
+  // The groups naming each user agent that are still to be visited.
+  std::vector<absl::Span<const int>> specific_groups(user_agents.size());
+  for (size_t i = 0; i < user_agents.size(); ++i) {
+    const int index = group_user_agents_.Find(user_agents[i]);
+    if (index >= 0) specific_groups[i] = groups_by_user_agent_[index];
+  }
+
+  for (int group_index = 0; group_index < static_cast<int>(groups_.size());
+       ++group_index) {
+    const Group& group = groups_[group_index];
+    bool any_specific = false;
+    for (size_t i = 0; i < user_agents.size(); ++i) {
+      is_specific[i] = !specific_groups[i].empty() &&
+                       specific_groups[i].front() == group_index;
+      if (is_specific[i]) {
+        specific_groups[i].remove_prefix(1);
+        any_specific = true;
       }
     }
-  } else {
-    // Google-specific optimization: 'index.htm' and 'index.html' are normalized
-    // to '/'.
-    const size_t slash_pos = value.find_last_of('/');
-
-    if (slash_pos != absl::string_view::npos &&
-        absl::StartsWith(absl::ClippedSubstr(value, slash_pos),
-                            "/index.htm")) {
-      const int len = slash_pos + 1;
-      absl::FixedArray<char> newpattern(len + 1);
-      strncpy(newpattern.data(), value.data(), len);
-      newpattern[len] = '$';
-      HandleAllow(line_num,
-                  absl::string_view(newpattern.data(), newpattern.size()));
-    }
-  }
-}
-
-void RobotsMatcher::HandleDisallow(int line_num, absl::string_view value) {
-  if (!seen_any_agent()) return;
-  seen_separator_ = true;
-  const int priority = match_strategy_->MatchDisallow(path_, value);
-  if (priority >= 0) {
-    if (seen_specific_agent_) {
-      if (disallow_.specific.priority() < priority) {
-        disallow_.specific.Set(priority, line_num);
+    if (!any_specific && !group.is_global) continue;
+
+    RobotsMatcher::Match group_allow;
+    RobotsMatcher::Match group_disallow;
+    MatchGroup(group, path, &group_allow, &group_disallow);
+    for (size_t i = 0; i < user_agents.size(); ++i) {
+      if (!is_specific[i] && !group.is_global) continue;
+      if (is_specific[i]) ever_seen_specific_agent[i] = true;
+      RobotsMatcher::Match& allow_match =
+          is_specific[i] ? allow[i].specific : allow[i].global;
+      if (allow_match.priority() < group_allow.priority()) {
+        allow_match = group_allow;
       }
-    } else {
-      assert(seen_global_agent_);
-      if (disallow_.global.priority() < priority) {
-        disallow_.global.Set(priority, line_num);
+      RobotsMatcher::Match& disallow_match =
+          is_specific[i] ? disallow[i].specific : disallow[i].global;
+      if (disallow_match.priority() < group_disallow.priority()) {
+        disallow_match = group_disallow;
       }
     }
   }
+
+  std::vector<RobotsVerdict> verdicts(user_agents.size());
+  for (size_t i = 0; i < user_agents.size(); ++i) {
+    verdicts[i].allowed = !RobotsMatcher::Disallow(
+        allow[i], disallow[i], ever_seen_specific_agent[i]);
+    verdicts[i].matching_line = RobotsMatcher::MatchingLine(
+        allow[i], disallow[i], ever_seen_specific_agent[i]);
+  }
+  return verdicts;
 }
 
-int LongestMatchRobotsMatchStrategy::MatchAllow(absl::string_view path,
-                                                absl::string_view pattern) {
-  return Matches(path, pattern) ? pattern.length() : -1;
+std::vector<RobotsVerdict> AllowedByRobotsPerAgent(
+    absl::string_view robots_body, const std::vector<std::string>& user_agents,
+    absl::string_view url) {
+  return CompiledRobots(robots_body).EvaluatePerAgent(user_agents, url);
 }
 
-int LongestMatchRobotsMatchStrategy::MatchDisallow(absl::string_view path,
-                                                   absl::string_view pattern) {
-  return Matches(path, pattern) ? pattern.length() : -1;
+std::vector<RobotsVerdict> CompiledRobots::EvaluateBatch(
+    const std::vector<std::string>& user_agents,
+    absl::Span<const absl::string_view> urls) const {
+  std::vector<RobotsVerdict> verdicts;
+  verdicts.reserve(urls.size());
+  std::string path_buffer;
+  for (const absl::string_view url : urls) {
+    verdicts.push_back(
+        EvaluatePath(user_agents, GetPathParamsQuery(url, &path_buffer)));
+  }
+  return verdicts;
 }
 
-void RobotsMatcher::HandleSitemap(int line_num, absl::string_view value) {}
+std::vector<RobotsVerdict> AllowedByRobotsBatch(
+    absl::string_view robots_body, const std::vector<std::string>& user_agents,
+    absl::Span<const absl::string_view> urls) {
+  return CompiledRobots(robots_body).EvaluateBatch(user_agents, urls);
+}
 
-void RobotsMatcher::HandleUnknownAction(int line_num, absl::string_view action,
-                                        absl::string_view value) {}
+/*static*/ void CompiledRobots::IndexGroup(Group* group) {
+  std::vector<TrieNode>& trie = group->literal_trie;
+  trie.assign(1, TrieNode());
+  const auto index_rules = [&trie](const std::vector<Rule>& rules,
+                                   bool is_allow, std::vector<int>* wildcards) {
+    for (int i = 0; i < static_cast<int>(rules.size()); ++i) {
+      const Rule& rule = rules[i];
+      if (rule.kind == PatternKind::WILDCARD) {
+        wildcards->push_back(i);
+        continue;
+      }
+      absl::string_view literal = rule.pattern;
+      const bool is_anchored = rule.kind == PatternKind::LITERAL_END_ANCHORED;
+      if (is_anchored) literal.remove_suffix(1);
+      int node = 0;
+      for (const char c : literal) {
+        int child = trie[node].first_child;
+        while (child >= 0 && trie[child].label != c) {
+          child = trie[child].next_sibling;
+        }
+        if (child < 0) {
+          child = trie.size();
+          trie.emplace_back();
+          trie[child].label = c;
+          trie[child].next_sibling = trie[node].first_child;
+          trie[node].first_child = child;
+        }
+        node = child;
+      }
+      TrieNode& end = trie[node];
+      int& line = is_allow ? (is_anchored ? end.anchored_allow_line
+                                          : end.allow_line)
+                           : (is_anchored ? end.anchored_disallow_line
+                                          : end.disallow_line);
+      // Rules are in file order, for equal patterns the first one wins.
+      if (line == 0) line = rule.line;
+    }
+  };
+  index_rules(group->allow, /*is_allow=*/true, &group->wildcard_allow);
+  index_rules(group->disallow, /*is_allow=*/false, &group->wildcard_disallow);
+
+  // Longest patterns first. The sort is stable, so that patterns of the same
+  // length stay in file order.
+  const auto sort_by_length = [](const std::vector<Rule>& rules,
+                                 std::vector<int>* wildcards) {
+    std::stable_sort(wildcards->begin(), wildcards->end(),
+                     [&rules](int a, int b) {
+                       return rules[a].pattern.size() > rules[b].pattern.size();
+                     });
+  };
+  sort_by_length(group->allow, &group->wildcard_allow);
+  sort_by_length(group->disallow, &group->wildcard_disallow);
+
+  // Paths start with '/', so '/' followed by any number of '*' matches all of
+  // them, as does a pattern of '*' only.
+  const auto matches_any_path = [](absl::string_view pattern) {
+    if (absl::StartsWith(pattern, "/")) pattern.remove_prefix(1);
+    return pattern.find_first_not_of('*') == absl::string_view::npos;
+  };
+  // A literal pattern looks at as many bytes of the path as it's long, and one
+  // anchored with '$' at one more byte than its literal part, to see whether
+  // the path ends there. Trailing '*' match anything, so they don't look any
+  // further than the literal part before them.
+  const auto decisive_length = [](const Rule& rule) {
+    if (rule.kind != PatternKind::WILDCARD) return rule.pattern.size();
+    const size_t first_wildcard = rule.pattern.find('*');
+    return rule.pattern.find_first_not_of('*', first_wildcard) ==
+                   absl::string_view::npos
+               ? first_wildcard
+               : absl::string_view::npos;
+  };
+  RuleSummary& summary = group->summary;
+  for (const Rule& rule : group->allow) {
+    summary.has_allow |= !rule.pattern.empty();
+    summary.decisive_length =
+        std::max(summary.decisive_length, decisive_length(rule));
+  }
+  for (const Rule& rule : group->disallow) {
+    if (rule.pattern.empty()) continue;
+    summary.has_disallow = true;
+    summary.disallows_all |= matches_any_path(rule.pattern);
+    summary.decisive_length =
+        std::max(summary.decisive_length, decisive_length(rule));
+  }
+}
+
+/*static*/ void CompiledRobots::MatchGroup(const Group& group,
+                                           absl::string_view path,
+                                           RobotsMatcher::Match* allow,
+                                           RobotsMatcher::Match* disallow) {
+  allow->Clear();
+  disallow->Clear();
+
+  // Each node on the walk is deeper than the previous one, so its patterns are
+  // longer than any literal pattern matched so far.
+  const std::vector<TrieNode>& trie = group.literal_trie;
+  int node = 0;
+  for (size_t depth = 0;; ++depth) {
+    const TrieNode& current = trie[node];
+    if (current.allow_line > 0) allow->Set(depth, current.allow_line);
+    if (current.disallow_line > 0) disallow->Set(depth, current.disallow_line);
+    if (depth == path.size()) {
+      if (current.anchored_allow_line > 0) {
+        allow->Set(depth + 1, current.anchored_allow_line);
+      }
+      if (current.anchored_disallow_line > 0) {
+        disallow->Set(depth + 1, current.anchored_disallow_line);
+      }
+      break;
+    }
+    node = current.first_child;
+    while (node >= 0 && trie[node].label != path[depth]) {
+      node = trie[node].next_sibling;
+    }
+    if (node < 0) break;
+  }
+
+  // Replaces 'match' if the new match has a higher priority, or the same
+  // priority but an earlier line.
+  const auto keep_higher_priority = [](int priority, int line,
+                                       RobotsMatcher::Match* match) {
+    if (priority > match->priority() ||
+        (priority >= 0 && priority == match->priority() &&
+         line < match->line())) {
+      match->Set(priority, line);
+    }
+  };
+  // The wildcard patterns are sorted by decreasing length, and the priority of
+  // a match is the length of the pattern. The first pattern matching has the
+  // highest priority and the earliest line among those of its length, and none
+  // shorter than a match so far can win.
+  const auto matches = [path](const Rule& rule) {
+    return rule.wildcard != nullptr ? rule.wildcard->Matches(path)
+                                    : MatchesPositionSet(path, rule.pattern);
+  };
+  for (const int i : group.wildcard_allow) {
+    const Rule& rule = group.allow[i];
+    const int priority = rule.pattern.size();
+    if (priority < allow->priority()) break;
+    if (matches(rule)) {
+      keep_higher_priority(priority, rule.line, allow);
+      break;
+    }
+  }
+  for (const int i : group.wildcard_disallow) {
+    const Rule& rule = group.disallow[i];
+    const int priority = rule.pattern.size();
+    if (priority < disallow->priority()) break;
+    if (matches(rule)) {
+      keep_higher_priority(priority, rule.line, disallow);
+      break;
+    }
+  }
+}
+
+template <typename UserAgents>
+RobotsVerdict CompiledRobots::EvaluatePath(const UserAgents& user_agents,
+                                           absl::string_view path) const {
+  // Per-call state only, so that concurrent calls don't interfere.
+  RobotsMatcher::MatchHierarchy allow;
+  RobotsMatcher::MatchHierarchy disallow;
+  bool ever_seen_specific_agent = false;
+
+  // Only the global groups and the groups naming one of the user agents are
+  // matched. Their lists are merged to visit them in file order.
+  absl::Span<const int> global_groups = global_groups_;
+  absl::InlinedVector<absl::Span<const int>, 8> specific_groups;
+  for (const auto& agent : user_agents) {
+    const int index = group_user_agents_.Find(agent);
+    if (index >= 0) specific_groups.push_back(groups_by_user_agent_[index]);
+  }
+  const int num_groups = static_cast<int>(groups_.size());
+  while (true) {
+    int group_index = global_groups.empty() ? num_groups : global_groups[0];
+    for (const absl::Span<const int>& groups : specific_groups) {
+      if (!groups.empty()) group_index = std::min(group_index, groups[0]);
+    }
+    if (group_index == num_groups) break;
+    if (!global_groups.empty() && global_groups[0] == group_index) {
+      global_groups.remove_prefix(1);
+    }
+    bool is_specific = false;
+    for (absl::Span<const int>& groups : specific_groups) {
+      if (!groups.empty() && groups[0] == group_index) {
+        groups.remove_prefix(1);
+        is_specific = true;
+      }
+    }
+    const Group& group = groups_[group_index];
+    ever_seen_specific_agent |= is_specific;
+
+    RobotsMatcher::Match group_allow;
+    RobotsMatcher::Match group_disallow;
+    MatchGroup(group, path, &group_allow, &group_disallow);
+    // Groups are in file order, so a tie keeps the earlier line.
+    RobotsMatcher::Match& allow_match =
+        is_specific ? allow.specific : allow.global;
+    if (allow_match.priority() < group_allow.priority()) {
+      allow_match = group_allow;
+    }
+    RobotsMatcher::Match& disallow_match =
+        is_specific ? disallow.specific : disallow.global;
+    if (disallow_match.priority() < group_disallow.priority()) {
+      disallow_match = group_disallow;
+    }
+  }
+  RobotsVerdict verdict;
+  verdict.allowed =
+      !RobotsMatcher::Disallow(allow, disallow, ever_seen_specific_agent);
+  verdict.matching_line =
+      RobotsMatcher::MatchingLine(allow, disallow, ever_seen_specific_agent);
+  return verdict;
+}
+
+namespace {
+
+// The flat binary format of CompiledRobots. The data starts with a header of
+// 32-bit integers at the offsets below, followed by arrays of records of
+// 32-bit integers, and ends with the bytes of the patterns and user agents.
+//
+// Group record: the first node and number of nodes of the trie of its literal
+// patterns, then the first rule and number of rules of its wildcard Allow
+// patterns, then of its wildcard Disallow patterns. The wildcard rules of a
+// group are sorted by decreasing length, then by line, as in CompiledRobots.
+// Node record: the fields of CompiledRobots::TrieNode, the child and sibling
+// being relative to the first node of the group, or kNoNode. Children come
+// after their parent and siblings before each other, so that walks end.
+// Rule record: the offset of the pattern in the strings, its length and its
+// line.
+// User agent record: the offset of the lowercased user agent in the strings,
+// its length, the first group index and number of group indexes of the groups
+// naming it, and the RuleSummary::ToBits() of these groups. The records are
+// sorted by user agent.
+// Group index: the index of a group record. The global groups are a range of
+// group indexes as well.
+enum FlatHeader : size_t {
+  kMagicOffset = 0,
+  kVersionOffset = 4,
+  kTotalSizeOffset = 8,
+  kFlagsOffset = 12,  // kAllowsAllFlag and kDisallowsAllFlag.
+  kGlobalSummaryOffset = 16,
+  kNumGroupsOffset = 20,
+  kGroupsOffset = 24,
+  kNumNodesOffset = 28,
+  kNodesOffset = 32,
+  kNumRulesOffset = 36,
+  kRulesOffset = 40,
+  kNumUserAgentsOffset = 44,
+  kUserAgentsOffset = 48,
+  kNumGroupIndexesOffset = 52,
+  kGroupIndexesOffset = 56,
+  kFirstGlobalGroupOffset = 60,
+  kNumGlobalGroupsOffset = 64,
+  kStringsOffset = 68,
+  kStringsSizeOffset = 72,
+  kFlatHeaderSize = 76,
+};
+
+constexpr char kFlatMagic[4] = {'R', 'B', 'T', 'F'};
+constexpr uint32_t kAllowsAllFlag = 1;
+constexpr uint32_t kDisallowsAllFlag = 2;
+constexpr uint32_t kNoNode = 0xffffffff;
+constexpr size_t kGroupRecordSize = 24;
+constexpr size_t kNodeRecordSize = 28;
+constexpr size_t kRuleRecordSize = 12;
+constexpr size_t kUserAgentRecordSize = 20;
+constexpr size_t kGroupIndexSize = 4;
+
+void AppendUint32(uint32_t value, std::string* out) {
+  const char bytes[4] = {
+      static_cast<char>(value & 0xff), static_cast<char>((value >> 8) & 0xff),
+      static_cast<char>((value >> 16) & 0xff),
+      static_cast<char>((value >> 24) & 0xff)};
+  out->append(bytes, sizeof(bytes));
+}
+
+void WriteUint32(size_t offset, uint32_t value, std::string* out) {
+  std::string bytes;
+  AppendUint32(value, &bytes);
+  out->replace(offset, bytes.size(), bytes);
+}
+
+// Compares 'user_agent' lowercased with 'lowercase', as unsigned bytes.
+int CompareLowercase(absl::string_view lowercase,
+                     absl::string_view user_agent) {
+  const size_t size = std::min(lowercase.size(), user_agent.size());
+  for (size_t i = 0; i < size; ++i) {
+    const unsigned char a = lowercase[i];
+    const unsigned char b = absl::ascii_tolower(user_agent[i]);
+    if (a != b) return a < b ? -1 : 1;
+  }
+  if (lowercase.size() == user_agent.size()) return 0;
+  return lowercase.size() < user_agent.size() ? -1 : 1;
+}
+
+}  // namespace
+
+std::string CompiledRobots::Serialize() const {
+  std::string groups;
+  std::string nodes;
+  std::string rules;
+  std::string user_agents;
+  std::string group_indexes;
+  std::string strings;
+  uint32_t num_nodes = 0;
+  uint32_t num_rules = 0;
+  uint32_t num_group_indexes = 0;
+
+  for (const Group& group : groups_) {
+    AppendUint32(num_nodes, &groups);
+    AppendUint32(group.literal_trie.size(), &groups);
+    for (const TrieNode& node : group.literal_trie) {
+      AppendUint32(static_cast<unsigned char>(node.label), &nodes);
+      AppendUint32(node.first_child < 0 ? kNoNode : node.first_child, &nodes);
+      AppendUint32(node.next_sibling < 0 ? kNoNode : node.next_sibling, &nodes);
+      AppendUint32(node.allow_line, &nodes);
+      AppendUint32(node.disallow_line, &nodes);
+      AppendUint32(node.anchored_allow_line, &nodes);
+      AppendUint32(node.anchored_disallow_line, &nodes);
+      ++num_nodes;
+    }
+    const auto append_wildcards = [&](const std::vector<Rule>& group_rules,
+                                      const std::vector<int>& wildcards) {
+      AppendUint32(num_rules, &groups);
+      AppendUint32(wildcards.size(), &groups);
+      for (const int i : wildcards) {
+        const Rule& rule = group_rules[i];
+        AppendUint32(strings.size(), &rules);
+        AppendUint32(rule.pattern.size(), &rules);
+        AppendUint32(rule.line, &rules);
+        strings.append(rule.pattern);
+        ++num_rules;
+      }
+    };
+    append_wildcards(group.allow, group.wildcard_allow);
+    append_wildcards(group.disallow, group.wildcard_disallow);
+  }
+
+  std::vector<int> order(groups_by_user_agent_.size());
+  for (int i = 0; i < static_cast<int>(order.size()); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [this](int a, int b) {
+    return group_user_agents_.Member(a) < group_user_agents_.Member(b);
+  });
+  for (const int index : order) {
+    const absl::string_view user_agent = group_user_agents_.Member(index);
+    const std::vector<int>& agent_groups = groups_by_user_agent_[index];
+    AppendUint32(strings.size(), &user_agents);
+    AppendUint32(user_agent.size(), &user_agents);
+    AppendUint32(num_group_indexes, &user_agents);
+    AppendUint32(agent_groups.size(), &user_agents);
+    AppendUint32(summary_by_user_agent_[index].ToBits(), &user_agents);
+    strings.append(user_agent.data(), user_agent.size());
+    for (const int group : agent_groups) {
+      AppendUint32(group, &group_indexes);
+      ++num_group_indexes;
+    }
+  }
+  const uint32_t first_global_group = num_group_indexes;
+  for (const int group : global_groups_) {
+    AppendUint32(group, &group_indexes);
+    ++num_group_indexes;
+  }
+
+  std::string data(kFlatHeaderSize, '\0');
+  data.replace(kMagicOffset, sizeof(kFlatMagic), kFlatMagic,
+               sizeof(kFlatMagic));
+  WriteUint32(kVersionOffset, CompiledRobotsView::kFormatVersion, &data);
+  WriteUint32(kFlagsOffset,
+              (allows_all_ ? kAllowsAllFlag : 0) |
+                  (disallows_all_ ? kDisallowsAllFlag : 0),
+              &data);
+  WriteUint32(kGlobalSummaryOffset, global_summary_.ToBits(), &data);
+  const auto append_section = [&data](size_t count_offset, uint32_t count,
+                                      size_t offset_offset,
+                                      const std::string& section) {
+    WriteUint32(count_offset, count, &data);
+    WriteUint32(offset_offset, data.size(), &data);
+    data.append(section);
+  };
+  append_section(kNumGroupsOffset, groups_.size(), kGroupsOffset, groups);
+  append_section(kNumNodesOffset, num_nodes, kNodesOffset, nodes);
+  append_section(kNumRulesOffset, num_rules, kRulesOffset, rules);
+  append_section(kNumUserAgentsOffset, order.size(), kUserAgentsOffset,
+                 user_agents);
+  append_section(kNumGroupIndexesOffset, num_group_indexes,
+                 kGroupIndexesOffset, group_indexes);
+  WriteUint32(kFirstGlobalGroupOffset, first_global_group, &data);
+  WriteUint32(kNumGlobalGroupsOffset, global_groups_.size(), &data);
+  append_section(kStringsSizeOffset, strings.size(), kStringsOffset, strings);
+  WriteUint32(kTotalSizeOffset, data.size(), &data);
+  return data;
+}
+
+CompiledRobotsView::CompiledRobotsView(absl::string_view data) : data_(data) {
+  if (!ValidateHeader() || !Validate()) data_ = absl::string_view();
+}
+
+/*static*/ CompiledRobotsView CompiledRobotsView::Unchecked(
+    absl::string_view data) {
+  CompiledRobotsView view;
+  view.data_ = data;
+  if (!view.ValidateHeader()) view.data_ = absl::string_view();
+  return view;
+}
+
+uint32_t CompiledRobotsView::Read(size_t offset) const {
+  const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(data_.data()) + offset;
+  return static_cast<uint32_t>(bytes[0]) |
+         static_cast<uint32_t>(bytes[1]) << 8 |
+         static_cast<uint32_t>(bytes[2]) << 16 |
+         static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+bool CompiledRobotsView::ValidateHeader() const {
+  return data_.size() >= kFlatHeaderSize &&
+         memcmp(data_.data() + kMagicOffset, kFlatMagic, sizeof(kFlatMagic)) ==
+             0 &&
+         Read(kVersionOffset) == kFormatVersion &&
+         Read(kTotalSizeOffset) == data_.size();
+}
+
+bool CompiledRobotsView::Validate() const {
+  // 64-bit arithmetic, so that no sum of 32-bit integers overflows.
+  const auto fits = [this](uint64_t offset, uint64_t count,
+                           uint64_t record_size) {
+    return offset >= kFlatHeaderSize &&
+           offset + count * record_size <= data_.size();
+  };
+  const uint64_t num_groups = Read(kNumGroupsOffset);
+  const uint64_t num_nodes = Read(kNumNodesOffset);
+  const uint64_t num_rules = Read(kNumRulesOffset);
+  const uint64_t num_user_agents = Read(kNumUserAgentsOffset);
+  const uint64_t num_group_indexes = Read(kNumGroupIndexesOffset);
+  const uint64_t strings_size = Read(kStringsSizeOffset);
+  if (!fits(Read(kGroupsOffset), num_groups, kGroupRecordSize) ||
+      !fits(Read(kNodesOffset), num_nodes, kNodeRecordSize) ||
+      !fits(Read(kRulesOffset), num_rules, kRuleRecordSize) ||
+      !fits(Read(kUserAgentsOffset), num_user_agents, kUserAgentRecordSize) ||
+      !fits(Read(kGroupIndexesOffset), num_group_indexes, kGroupIndexSize) ||
+      !fits(Read(kStringsOffset), strings_size, 1) ||
+      uint64_t{Read(kFirstGlobalGroupOffset)} + Read(kNumGlobalGroupsOffset) >
+          num_group_indexes ||
+      Read(kGlobalSummaryOffset) > 7 || Read(kFlagsOffset) > 3) {
+    return false;
+  }
+  for (uint64_t i = 0; i < num_groups; ++i) {
+    const size_t record = Read(kGroupsOffset) + i * kGroupRecordSize;
+    const uint64_t first_node = Read(record);
+    const uint64_t group_nodes = Read(record + 4);
+    if (group_nodes == 0 || first_node + group_nodes > num_nodes ||
+        uint64_t{Read(record + 8)} + Read(record + 12) > num_rules ||
+        uint64_t{Read(record + 16)} + Read(record + 20) > num_rules) {
+      return false;
+    }
+    for (uint64_t node = 0; node < group_nodes; ++node) {
+      const size_t node_record =
+          Read(kNodesOffset) + (first_node + node) * kNodeRecordSize;
+      const uint32_t first_child = Read(node_record + 4);
+      const uint32_t next_sibling = Read(node_record + 8);
+      if (Read(node_record) > 0xff ||
+          (first_child != kNoNode &&
+           (first_child <= node || first_child >= group_nodes)) ||
+          (next_sibling != kNoNode && next_sibling >= node)) {
+        return false;
+      }
+    }
+  }
+  for (uint64_t i = 0; i < num_rules; ++i) {
+    const size_t record = Read(kRulesOffset) + i * kRuleRecordSize;
+    if (uint64_t{Read(record)} + Read(record + 4) > strings_size ||
+        Read(record + 4) > static_cast<uint32_t>(INT32_MAX)) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < num_user_agents; ++i) {
+    const size_t record = Read(kUserAgentsOffset) + i * kUserAgentRecordSize;
+    if (uint64_t{Read(record)} + Read(record + 4) > strings_size ||
+        uint64_t{Read(record + 8)} + Read(record + 12) > num_group_indexes ||
+        Read(record + 16) > 7) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < num_group_indexes; ++i) {
+    if (Read(Read(kGroupIndexesOffset) + i * kGroupIndexSize) >= num_groups) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int CompiledRobotsView::FindUserAgent(absl::string_view user_agent) const {
+  const absl::string_view strings =
+      data_.substr(Read(kStringsOffset), Read(kStringsSizeOffset));
+  const size_t user_agents = Read(kUserAgentsOffset);
+  int low = 0;
+  int high = Read(kNumUserAgentsOffset);
+  while (low < high) {
+    const int middle = low + (high - low) / 2;
+    const size_t record = user_agents + middle * kUserAgentRecordSize;
+    const int comparison = CompareLowercase(
+        strings.substr(Read(record), Read(record + 4)), user_agent);
+    if (comparison == 0) return middle;
+    if (comparison < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return -1;
+}
+
+bool CompiledRobotsView::allows_all() const {
+  return !valid() || (Read(kFlagsOffset) & kAllowsAllFlag) != 0;
+}
+
+bool CompiledRobotsView::disallows_all() const {
+  return valid() && (Read(kFlagsOffset) & kDisallowsAllFlag) != 0;
+}
+
+HostVerdict CompiledRobotsView::GetHostVerdict(
+    absl::string_view user_agent) const {
+  return GetHostVerdict(absl::MakeConstSpan(&user_agent, 1));
+}
+
+HostVerdict CompiledRobotsView::GetHostVerdict(
+    absl::Span<const absl::string_view> user_agents) const {
+  if (allows_all()) return HostVerdict::ALLOW_ALL;
+  if (disallows_all()) return HostVerdict::DISALLOW_ALL;
+  CompiledRobots::RuleSummary summary;
+  bool ever_seen_specific_agent = false;
+  for (const absl::string_view agent : user_agents) {
+    const int index = FindUserAgent(agent);
+    if (index >= 0) {
+      summary.Add(CompiledRobots::RuleSummary::FromBits(
+          Read(Read(kUserAgentsOffset) + index * kUserAgentRecordSize + 16)));
+      ever_seen_specific_agent = true;
+    }
+  }
+  return ever_seen_specific_agent
+             ? summary.verdict()
+             : CompiledRobots::RuleSummary::FromBits(
+                   Read(kGlobalSummaryOffset))
+                   .verdict();
+}
+
+bool CompiledRobotsView::IsAllowed(absl::string_view user_agent,
+                                   absl::string_view url) const {
+  return AllowedByRobots(absl::MakeConstSpan(&user_agent, 1), url);
+}
+
+bool CompiledRobotsView::AllowedByRobots(
+    absl::Span<const absl::string_view> user_agents,
+    absl::string_view url) const {
+  const HostVerdict host_verdict = GetHostVerdict(user_agents);
+  if (host_verdict != HostVerdict::PER_URL) {
+    return host_verdict == HostVerdict::ALLOW_ALL;
+  }
+  return Evaluate(user_agents, url).allowed;
+}
+
+RobotsVerdict CompiledRobotsView::Evaluate(absl::string_view user_agent,
+                                           absl::string_view url) const {
+  return Evaluate(absl::MakeConstSpan(&user_agent, 1), url);
+}
+
+RobotsVerdict CompiledRobotsView::Evaluate(
+    absl::Span<const absl::string_view> user_agents,
+    absl::string_view url) const {
+  if (!valid()) return RobotsVerdict();
+  std::string path_buffer;
+  return EvaluatePath(user_agents, GetPathParamsQuery(url, &path_buffer));
+}
+
+void CompiledRobotsView::MatchGroup(uint32_t group, absl::string_view path,
+                                    RobotsMatcherBase::Match* allow,
+                                    RobotsMatcherBase::Match* disallow) const {
+  // Same as CompiledRobots::MatchGroup(), see there.
+  allow->Clear();
+  disallow->Clear();
+  const size_t group_record = Read(kGroupsOffset) + group * kGroupRecordSize;
+
+  const size_t nodes =
+      Read(kNodesOffset) + Read(group_record) * kNodeRecordSize;
+  uint32_t node = 0;
+  for (size_t depth = 0;; ++depth) {
+    const size_t record = nodes + node * kNodeRecordSize;
+    if (const int line = Read(record + 12)) allow->Set(depth, line);
+    if (const int line = Read(record + 16)) disallow->Set(depth, line);
+    if (depth == path.size()) {
+      if (const int line = Read(record + 20)) allow->Set(depth + 1, line);
+      if (const int line = Read(record + 24)) disallow->Set(depth + 1, line);
+      break;
+    }
+    const uint32_t label = static_cast<unsigned char>(path[depth]);
+    node = Read(record + 4);
+    while (node != kNoNode && Read(nodes + node * kNodeRecordSize) != label) {
+      node = Read(nodes + node * kNodeRecordSize + 8);
+    }
+    if (node == kNoNode) break;
+  }
+
+  const absl::string_view strings =
+      data_.substr(Read(kStringsOffset), Read(kStringsSizeOffset));
+  LongestMatchRobotsMatchStrategy match_strategy;
+  const auto match_wildcards = [&](uint32_t first_rule, uint32_t num_rules,
+                                   RobotsMatcherBase::Match* match) {
+    const size_t rules = Read(kRulesOffset) + first_rule * kRuleRecordSize;
+    for (uint32_t i = 0; i < num_rules; ++i) {
+      const size_t record = rules + i * kRuleRecordSize;
+      const int length = Read(record + 4);
+      if (length < match->priority()) break;
+      const int priority = match_strategy.MatchAllow(
+          path, strings.substr(Read(record), length), PatternKind::WILDCARD);
+      if (priority < 0) continue;
+      const int line = Read(record + 8);
+      if (priority > match->priority() ||
+          (priority == match->priority() && line < match->line())) {
+        match->Set(priority, line);
+      }
+      break;
+    }
+  };
+  match_wildcards(Read(group_record + 8), Read(group_record + 12), allow);
+  match_wildcards(Read(group_record + 16), Read(group_record + 20), disallow);
+}
+
+RobotsVerdict CompiledRobotsView::EvaluatePath(
+    absl::Span<const absl::string_view> user_agents,
+    absl::string_view path) const {
+  RobotsMatcherBase::MatchHierarchy allow;
+  RobotsMatcherBase::MatchHierarchy disallow;
+  bool ever_seen_specific_agent = false;
+
+  // The ranges of group indexes to match, merged to visit the groups in file
+  // order as CompiledRobots::EvaluatePath() does.
+  struct GroupRange {
+    uint32_t first;
+    uint32_t end;
+  };
+  const size_t group_indexes = Read(kGroupIndexesOffset);
+  const auto group_at = [this, group_indexes](uint32_t i) {
+    return Read(group_indexes + i * kGroupIndexSize);
+  };
+  GroupRange global_groups = {Read(kFirstGlobalGroupOffset),
+                              Read(kFirstGlobalGroupOffset) +
+                                  Read(kNumGlobalGroupsOffset)};
+  absl::InlinedVector<GroupRange, 8> specific_groups;
+  for (const absl::string_view agent : user_agents) {
+    const int index = FindUserAgent(agent);
+    if (index < 0) continue;
+    const size_t record =
+        Read(kUserAgentsOffset) + index * kUserAgentRecordSize;
+    specific_groups.push_back(
+        {Read(record + 8), Read(record + 8) + Read(record + 12)});
+  }
+  const uint32_t num_groups = Read(kNumGroupsOffset);
+  while (true) {
+    uint32_t group_index = global_groups.first == global_groups.end
+                               ? num_groups
+                               : group_at(global_groups.first);
+    for (const GroupRange& groups : specific_groups) {
+      if (groups.first != groups.end) {
+        group_index = std::min(group_index, group_at(groups.first));
+      }
+    }
+    if (group_index == num_groups) break;
+    if (global_groups.first != global_groups.end &&
+        group_at(global_groups.first) == group_index) {
+      ++global_groups.first;
+    }
+    bool is_specific = false;
+    for (GroupRange& groups : specific_groups) {
+      if (groups.first != groups.end && group_at(groups.first) == group_index) {
+        ++groups.first;
+        is_specific = true;
+      }
+    }
+    ever_seen_specific_agent |= is_specific;
+
+    RobotsMatcherBase::Match group_allow;
+    RobotsMatcherBase::Match group_disallow;
+    MatchGroup(group_index, path, &group_allow, &group_disallow);
+    // Groups are in file order, so a tie keeps the earlier line.
+    RobotsMatcherBase::Match& allow_match =
+        is_specific ? allow.specific : allow.global;
+    if (allow_match.priority() < group_allow.priority()) {
+      allow_match = group_allow;
+    }
+    RobotsMatcherBase::Match& disallow_match =
+        is_specific ? disallow.specific : disallow.global;
+    if (disallow_match.priority() < group_disallow.priority()) {
+      disallow_match = group_disallow;
+    }
+  }
+  RobotsVerdict verdict;
+  verdict.allowed =
+      !RobotsMatcherBase::Disallow(allow, disallow, ever_seen_specific_agent);
+  verdict.matching_line = RobotsMatcherBase::MatchingLine(
+      allow, disallow, ever_seen_specific_agent);
+  return verdict;
+}
 
 }  // namespace googlebot
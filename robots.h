@@ -34,10 +34,15 @@
 #ifndef THIRD_PARTY_ROBOTSTXT_ROBOTS_H__
 #define THIRD_PARTY_ROBOTSTXT_ROBOTS_H__
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace googlebot {
 
@@ -54,6 +59,54 @@ enum class KeyType {
 // Returns KeyType for a given key string, indicating if it's a typo.
 KeyType GetKeyType(absl::string_view key, bool* is_acceptable_typo);
 
+// The kind of an Allow or Disallow pattern, which determines how it's matched
+// against a path. Most patterns found in the wild are literal.
+enum class PatternKind {
+  // No '*' and no trailing '$': matches the paths starting with the pattern.
+  LITERAL = 0,
+  // No '*' but a trailing '$': matches only the pattern without the '$'.
+  LITERAL_END_ANCHORED = 1,
+  // Contains '*', maybe a trailing '$' as well.
+  WILDCARD = 2,
+};
+
+// Returns the PatternKind of an Allow or Disallow pattern.
+PatternKind GetPatternKind(absl::string_view pattern);
+
+// A WILDCARD pattern prepared once to be matched against many paths. The
+// literal prefix before the first '*' is compared as is, and the rest of the
+// pattern is run as a Shift-And automaton, one step per character of the path.
+// Matching doesn't allocate.
+class WildcardPattern {
+ public:
+  // The most characters other than '*' and a trailing '$' a pattern can have
+  // after its literal prefix.
+  static constexpr int kMaxChars = 63;
+
+  // Returns true if 'pattern' has at most kMaxChars characters other than '*'
+  // and a trailing '$' from its first '*' on.
+  static bool Fits(absl::string_view pattern);
+
+  // 'pattern' must fit, see Fits().
+  explicit WildcardPattern(absl::string_view pattern);
+
+  // Same as RobotsMatchStrategy::Matches() for the pattern.
+  bool Matches(absl::string_view path) const;
+
+  // Returns the number of bytes used by the pattern.
+  size_t MemoryUsage() const;
+
+ private:
+  std::string prefix_;
+  bool anchored_at_end_ = false;
+  uint64_t self_loops_ = 0;
+  uint64_t accept_ = 0;
+  // masks_[classes_[c]] is the transition mask of the character c, class 0 is
+  // that of the characters not in the pattern.
+  uint8_t classes_[256] = {};
+  std::vector<uint64_t> masks_;
+};
+
 // Handler for directives found in robots.txt. These callbacks are called by
 // ParseRobotsTxt() in the sequence they have been found in the file.
 class RobotsParseHandler {
@@ -101,48 +154,257 @@ class RobotsParseHandler {
   virtual void ReportLineMetadata(int line_num, const LineMetadata& metadata) {}
 };
 
+// Limits on how much of a robots.txt is parsed, to bound the work and memory
+// spent on a single host. Parsing stops at the first limit reached, as if the
+// body ended there. A limit of 0 means no limit.
+struct RobotsParseLimits {
+  // RFC 9309 lets crawlers stop parsing after 500 KiB.
+  static constexpr size_t kRfc9309MaxBytes = 500 * 1024;
+
+  // Maximum number of bytes of the body parsed. Lines that don't end within
+  // them are ignored.
+  size_t max_bytes = 0;
+  // Maximum number of lines parsed.
+  int max_lines = 0;
+  // Maximum number of Allow and Disallow rules parsed in a group, and in the
+  // whole body.
+  int max_rules_per_group = 0;
+  int max_rules = 0;
+};
+
+// What was parsed of a robots.txt, and which limit made parsing stop early,
+// if any.
+struct RobotsParseReport {
+  // Number of lines, and of Allow and Disallow rules, passed to the handler.
+  int lines = 0;
+  int rules = 0;
+  // Indicates that parsing stopped before the end of the body because of the
+  // matching RobotsParseLimits field.
+  bool exceeded_max_bytes = false;
+  bool exceeded_max_lines = false;
+  bool exceeded_max_rules_per_group = false;
+  bool exceeded_max_rules = false;
+
+  // Returns true if parsing stopped before the end of the body.
+  bool limit_reached() const {
+    return exceeded_max_bytes || exceeded_max_lines ||
+           exceeded_max_rules_per_group || exceeded_max_rules;
+  }
+};
+
+class RobotsTxtParser;
+
+// Scratch space used while parsing a robots.txt: the buffer patterns that
+// need escaping are escaped into. Passing the same context to many
+// ParseRobotsTxt() calls avoids allocating it for every robots.txt. A context
+// can only be used by one parse at a time.
+class RobotsParseContext {
+ public:
+  RobotsParseContext();
+  ~RobotsParseContext();
+
+  // Disallow copying and assignment.
+  RobotsParseContext(const RobotsParseContext&) = delete;
+  RobotsParseContext& operator=(const RobotsParseContext&) = delete;
+
+ private:
+  friend class RobotsTxtParser;
+
+  std::string escaped_value_;
+};
+
 // Parses body of a robots.txt and emits parse callbacks. This will accept
-// typical typos found in robots.txt, such as 'disalow'.
+// typical typos found in robots.txt, such as 'disalow'. The values passed to
+// the callbacks point into 'robots_body' unless they had to be escaped, and
+// are only valid during the callback.
 //
 // Note, this function will accept all kind of input but will skip
 // everything that does not look like a robots directive.
+//
+// The first overload reuses a context kept by the calling thread.
 void ParseRobotsTxt(absl::string_view robots_body,
                     RobotsParseHandler* parse_callback);
+void ParseRobotsTxt(absl::string_view robots_body,
+                    RobotsParseHandler* parse_callback,
+                    RobotsParseContext* context);
+
+// Same as above, but stops at the first of the 'limits' reached. The handler
+// still gets HandleRobotsEnd(). Returns what was parsed.
+RobotsParseReport ParseRobotsTxt(absl::string_view robots_body,
+                                 RobotsParseHandler* parse_callback,
+                                 const RobotsParseLimits& limits,
+                                 RobotsParseContext* context);
+
+// Parses a robots.txt that arrives in chunks, such as while it's read from the
+// network, and emits the same callbacks in the same order as ParseRobotsTxt()
+// does for the whole body. Lines are emitted as soon as they are complete.
+// Only the start of an incomplete line is kept between calls, and no more of
+// it than the parser looks at.
+//
+//   RobotsTxtStreamParser parser(&handler);
+//   while (ReadChunk(&chunk)) parser.Feed(chunk);
+//   parser.Finish();
+class RobotsTxtStreamParser {
+ public:
+  // Calls HandleRobotsStart() on 'parse_callback'.
+  explicit RobotsTxtStreamParser(RobotsParseHandler* parse_callback);
+  RobotsTxtStreamParser(RobotsParseHandler* parse_callback,
+                        const RobotsParseLimits& limits);
+  ~RobotsTxtStreamParser();
+
+  // Disallow copying and assignment.
+  RobotsTxtStreamParser(const RobotsTxtStreamParser&) = delete;
+  RobotsTxtStreamParser& operator=(const RobotsTxtStreamParser&) = delete;
+
+  // Parses the next chunk of the body. The values passed to the callbacks are
+  // only valid during the callback.
+  void Feed(absl::string_view chunk);
+
+  // Parses the last line of the body and calls HandleRobotsEnd(). Must be
+  // called once, after the last Feed().
+  void Finish();
+
+  // Returns what was parsed so far. Once a limit is reached, the rest of the
+  // body is ignored and doesn't need to be fed.
+  const RobotsParseReport& report() const;
+
+ private:
+  void AppendToPartialLine(absl::string_view data);
+
+  RobotsParseContext context_;
+  // The start of a line that didn't end in the chunks fed so far.
+  std::string partial_line_;
+  std::unique_ptr<RobotsTxtParser> parser_;
+  bool finished_ = false;
+};
 
-// RobotsMatcher - matches robots.txt against URLs.
+// A set of user agents that are compared ignoring case, as in robots.txt.
+// Looking up a user agent hashes it once instead of comparing it with every
+// member, so that long lists of user agents are cheap to check.
+class UserAgentSet {
+ public:
+  UserAgentSet() = default;
+
+  // Adds 'user_agent' if it's not in the set yet. Returns its index, which is
+  // the number of user agents added before it.
+  int Insert(absl::string_view user_agent);
+
+  // Returns the index of 'user_agent' in the set, or -1 if it's not in it.
+  int Find(absl::string_view user_agent) const;
+  bool Contains(absl::string_view user_agent) const {
+    return Find(user_agent) >= 0;
+  }
+
+  int size() const { return static_cast<int>(members_.size()); }
+
+  // Removes all user agents, keeping the memory allocated for them.
+  void Clear();
+
+  // Returns the number of bytes allocated for the user agents.
+  size_t MemoryUsage() const;
+
+  // Returns the user agent of 'index', lowercased.
+  absl::string_view Member(int index) const;
+
+ private:
+  // Returns the slot of 'user_agent', which is either empty or holds it.
+  size_t FindSlot(absl::string_view user_agent) const;
+  void Rehash(size_t num_slots);
+
+  // The members lowercased, one after the other.
+  std::string chars_;
+  // Offset and length of each member in 'chars_'.
+  std::vector<std::pair<size_t, size_t>> members_;
+  // Open addressing table of member indexes, with -1 for empty slots. The
+  // number of slots is a power of two.
+  std::vector<int> slots_;
+};
+
+// A RobotsMatchStrategy defines a strategy for matching individual lines in a
+// robots.txt file. Each Match* method should return a match priority, which is
+// interpreted as:
 //
-// The Matcher uses a default match strategy for Allow/Disallow patterns which
-// is the official way of Google crawler to match robots.txt. It is also
-// possible to provide a custom match strategy.
+// match priority < 0:
+//    No match.
 //
-// The entry point for the user is to call one of the *AllowedByRobots()
-// methods that return directly if a URL is being allowed according to the
-// robots.txt and the crawl agent.
-// The RobotsMatcher can be re-used for URLs/robots.txt but is not thread-safe.
+// match priority == 0:
+//    Match, but treat it as if matched an empty pattern.
+//
+// match priority > 0:
+//    Match.
+class RobotsMatchStrategy {
+ public:
+  virtual ~RobotsMatchStrategy() = default;
 
-class RobotsMatchStrategy;
+  virtual int MatchAllow(absl::string_view path,
+                         absl::string_view pattern) = 0;
+  virtual int MatchDisallow(absl::string_view path,
+                            absl::string_view pattern) = 0;
+
+ protected:
+  // Implements robots.txt pattern matching.
+  static bool Matches(absl::string_view path, absl::string_view pattern);
+  // Same, for a pattern whose kind is already known.
+  static bool Matches(absl::string_view path, absl::string_view pattern,
+                      PatternKind kind);
+};
 
-class RobotsMatcher : protected RobotsParseHandler {
+// Implements the default robots.txt matching strategy. The maximum number of
+// characters matched by a pattern is returned as its match priority.
+class LongestMatchRobotsMatchStrategy final : public RobotsMatchStrategy {
  public:
-  // Create a RobotsMatcher with the default matching strategy. The default
-  // matching strategy is longest-match as opposed to the former internet draft
-  // that provisioned first-match strategy. Analysis shows that longest-match,
-  // while more restrictive for crawlers, is what webmasters assume when writing
-  // directives. For example, in case of conflicting matches (both Allow and
-  // Disallow), the longest match is the one the user wants. For example, in
-  // case of a robots.txt file that has the following rules
-  //   Allow: /
-  //   Disallow: /cgi-bin
-  // it's pretty obvious what the webmaster wants: they want to allow crawl of
-  // every URI except /cgi-bin. However, according to the expired internet
-  // standard, crawlers should be allowed to crawl everything with such a rule.
-  RobotsMatcher();
-
-  ~RobotsMatcher() override;
+  int MatchAllow(absl::string_view path, absl::string_view pattern) override {
+    return Matches(path, pattern) ? pattern.length() : -1;
+  }
+  int MatchDisallow(absl::string_view path,
+                    absl::string_view pattern) override {
+    return Matches(path, pattern) ? pattern.length() : -1;
+  }
+
+  // Same as above, for patterns classified ahead of time by GetPatternKind().
+  // Literal patterns are matched with a single comparison.
+  int MatchAllow(absl::string_view path, absl::string_view pattern,
+                 PatternKind kind) {
+    return Matches(path, pattern, kind) ? pattern.length() : -1;
+  }
+  int MatchDisallow(absl::string_view path, absl::string_view pattern,
+                    PatternKind kind) {
+    return Matches(path, pattern, kind) ? pattern.length() : -1;
+  }
+};
+
+// Lets BasicRobotsMatcher use a match strategy chosen at run time, through
+// the virtual methods of RobotsMatchStrategy.
+class DynamicRobotsMatchStrategy {
+ public:
+  explicit DynamicRobotsMatchStrategy(
+      std::unique_ptr<RobotsMatchStrategy> strategy)
+      : strategy_(std::move(strategy)) {}
+
+  int MatchAllow(absl::string_view path, absl::string_view pattern) {
+    return strategy_->MatchAllow(path, pattern);
+  }
+  int MatchDisallow(absl::string_view path, absl::string_view pattern) {
+    return strategy_->MatchDisallow(path, pattern);
+  }
+
+ private:
+  std::unique_ptr<RobotsMatchStrategy> strategy_;
+};
+
+class RobotsGroupIndex;
+class CompiledRobots;
+
+// The state and verdict logic shared by all BasicRobotsMatcher, whatever
+// their match strategy. Use RobotsMatcher, or BasicRobotsMatcher for a custom
+// match strategy.
+class RobotsMatcherBase : protected RobotsParseHandler {
+ public:
+  ~RobotsMatcherBase() override;
 
   // Disallow copying and assignment.
-  RobotsMatcher(const RobotsMatcher&) = delete;
-  RobotsMatcher& operator=(const RobotsMatcher&) = delete;
+  RobotsMatcherBase(const RobotsMatcherBase&) = delete;
+  RobotsMatcherBase& operator=(const RobotsMatcherBase&) = delete;
 
   // Verifies that the given user agent is valid to be matched against
   // robots.txt. Valid user agent strings only contain the characters
@@ -153,13 +415,26 @@ class RobotsMatcher : protected RobotsParseHandler {
   // "user_agents" vector. 'url' must be %-encoded according to RFC3986.
   bool AllowedByRobots(absl::string_view robots_body,
                        const std::vector<std::string>* user_agents,
-                       const std::string& url);
+                       absl::string_view url);
+  bool AllowedByRobots(absl::string_view robots_body,
+                       absl::Span<const absl::string_view> user_agents,
+                       absl::string_view url);
 
   // Do robots check for 'url' when there is only one user agent. 'url' must
   // be %-encoded according to RFC3986.
   bool OneAgentAllowedByRobots(absl::string_view robots_txt,
-                               const std::string& user_agent,
-                               const std::string& url);
+                               absl::string_view user_agent,
+                               absl::string_view url);
+
+  // Same as above, parsing only the groups of 'robots' that apply to the
+  // user agents. The verdicts and matching lines are the same as for the
+  // whole robots.txt body.
+  bool AllowedByRobots(const RobotsGroupIndex& robots,
+                       absl::Span<const absl::string_view> user_agents,
+                       absl::string_view url);
+  bool OneAgentAllowedByRobots(const RobotsGroupIndex& robots,
+                               absl::string_view user_agent,
+                               absl::string_view url);
 
   // Returns true if we are disallowed from crawling a matching URI.
   bool disallow() const;
@@ -177,15 +452,16 @@ class RobotsMatcher : protected RobotsParseHandler {
   int matching_line() const;
 
  protected:
+  RobotsMatcherBase();
+
   // Parse callbacks.
   // Protected because used in unittest. Never override RobotsMatcher, implement
-  // googlebot::RobotsParseHandler instead.
+  // googlebot::RobotsParseHandler instead. HandleAllow() and HandleDisallow()
+  // are implemented by BasicRobotsMatcher.
   void HandleRobotsStart() override;
   void HandleRobotsEnd() override {}
 
   void HandleUserAgent(int line_num, absl::string_view user_agent) override;
-  void HandleAllow(int line_num, absl::string_view value) override;
-  void HandleDisallow(int line_num, absl::string_view value) override;
 
   void HandleSitemap(int line_num, absl::string_view value) override;
   void HandleUnknownAction(int line_num, absl::string_view action,
@@ -201,6 +477,13 @@ class RobotsMatcher : protected RobotsParseHandler {
   // path, params, and query (if any) of the url and must start with a '/'.
   void InitUserAgentsAndPath(const std::vector<std::string>* user_agents,
                              const char* path);
+  void InitUserAgentsAndPath(absl::Span<const absl::string_view> user_agents,
+                             absl::string_view path);
+
+  // CompiledRobots shares the match bookkeeping and verdict logic below.
+  friend class CompiledRobots;
+  friend class CompiledRobotsView;
+  friend class RobotsGroupIndex;
 
   // Returns true if any user-agent was seen.
   bool seen_any_agent() const {
@@ -260,20 +543,452 @@ class RobotsMatcher : protected RobotsParseHandler {
   MatchHierarchy allow_;     // Characters of 'url' matching Allow.
   MatchHierarchy disallow_;  // Characters of 'url' matching Disallow.
 
+  // Returns true if the given Allow and Disallow matches disallow crawling.
+  // See disallow().
+  static bool Disallow(const MatchHierarchy& allow,
+                       const MatchHierarchy& disallow,
+                       bool ever_seen_specific_agent);
+  // Returns the line of the given matches deciding the verdict. See
+  // matching_line().
+  static int MatchingLine(const MatchHierarchy& allow,
+                          const MatchHierarchy& disallow,
+                          bool ever_seen_specific_agent);
+
+  // Records a match of 'priority' with the rule on 'line_num' in 'matches', for
+  // the user agents of the current group.
+  void RecordMatch(MatchHierarchy* matches, int line_num, int priority);
+  // Google-specific optimization: retries an Allow 'value' that didn't match,
+  // when it's an index file, as the pattern of its directory.
+  void HandleIndexFileAllow(int line_num, absl::string_view value);
+
   bool seen_global_agent_;         // True if processing global agent rules.
   bool seen_specific_agent_;       // True if processing our specific agent.
   bool ever_seen_specific_agent_;  // True if we ever saw a block for our agent.
   bool seen_separator_;            // True if saw any key: value pair.
 
-  // The path we want to pattern match. Not owned and only a valid pointer
+  // The path we want to pattern match. Not owned and only a valid view
   // during the lifetime of *AllowedByRobots calls.
-  const char* path_;
-  // The User-Agents we are interested in. Not owned and only a valid
-  // pointer during the lifetime of *AllowedByRobots calls.
-  const std::vector<std::string>* user_agents_;
+  absl::string_view path_;
+  // The User-Agents we are interested in, for looking up the ones in the
+  // robots.txt in constant time.
+  UserAgentSet user_agent_set_;
+
+  // Buffers reused across *AllowedByRobots calls, so that checks don't
+  // allocate once they have grown large enough: views of user agents given as
+  // std::string, and the path when it can't point into the URL.
+  std::vector<absl::string_view> user_agent_views_;
+  std::string path_buffer_;
+  // Reused across parses of the robots.txt bodies.
+  RobotsParseContext parse_context_;
+};
 
-  RobotsMatchStrategy* match_strategy_;
+// BasicRobotsMatcher - matches robots.txt against URLs.
+//
+// The Matcher uses a match strategy for Allow/Disallow patterns fixed at
+// compile time, so that matching a rule costs no virtual call. RobotsMatcher
+// uses the default strategy, which is the official way of Google crawler to
+// match robots.txt. It is also possible to provide a custom match strategy,
+// either as a class with the MatchAllow() and MatchDisallow() methods of
+// RobotsMatchStrategy, or as a RobotsMatchStrategy chosen at run time with
+// BasicRobotsMatcher<DynamicRobotsMatchStrategy>.
+//
+// The entry point for the user is to call one of the *AllowedByRobots()
+// methods that return directly if a URL is being allowed according to the
+// robots.txt and the crawl agent.
+// The RobotsMatcher can be re-used for URLs/robots.txt but is not thread-safe.
+// To share one parsed robots.txt between threads, use CompiledRobots instead.
+template <typename Strategy>
+class BasicRobotsMatcher : public RobotsMatcherBase {
+ public:
+  BasicRobotsMatcher() = default;
+  explicit BasicRobotsMatcher(Strategy strategy)
+      : strategy_(std::move(strategy)) {}
+
+ protected:
+  void HandleAllow(int line_num, absl::string_view value) final;
+  void HandleDisallow(int line_num, absl::string_view value) final;
+
+ private:
+  Strategy strategy_;
 };
 
+template <typename Strategy>
+void BasicRobotsMatcher<Strategy>::HandleAllow(int line_num,
+                                               absl::string_view value) {
+  if (!seen_any_agent()) return;
+  seen_separator_ = true;
+  const int priority = strategy_.MatchAllow(path_, value);
+  if (priority >= 0) {
+    RecordMatch(&allow_, line_num, priority);
+  } else {
+    HandleIndexFileAllow(line_num, value);
+  }
+}
+
+template <typename Strategy>
+void BasicRobotsMatcher<Strategy>::HandleDisallow(int line_num,
+                                                  absl::string_view value) {
+  if (!seen_any_agent()) return;
+  seen_separator_ = true;
+  const int priority = strategy_.MatchDisallow(path_, value);
+  if (priority >= 0) {
+    RecordMatch(&disallow_, line_num, priority);
+  }
+}
+
+// The matcher with the default matching strategy. The default matching
+// strategy is longest-match as opposed to the former internet draft that
+// provisioned first-match strategy. Analysis shows that longest-match, while
+// more restrictive for crawlers, is what webmasters assume when writing
+// directives. For example, in case of conflicting matches (both Allow and
+// Disallow), the longest match is the one the user wants. For example, in case
+// of a robots.txt file that has the following rules
+//   Allow: /
+//   Disallow: /cgi-bin
+// it's pretty obvious what the webmaster wants: they want to allow crawl of
+// every URI except /cgi-bin. However, according to the expired internet
+// standard, crawlers should be allowed to crawl everything with such a rule.
+using RobotsMatcher = BasicRobotsMatcher<LongestMatchRobotsMatchStrategy>;
+extern template class BasicRobotsMatcher<LongestMatchRobotsMatchStrategy>;
+
+// The byte ranges of the groups of a robots.txt and the user agents they apply
+// to, found by parsing it once. RobotsMatcher uses it to parse only the groups
+// that apply to the user agents it checks, which saves most of the work for
+// robots.txt files with many groups for other crawlers.
+//
+// The index points into the robots.txt body, which must outlive it.
+class RobotsGroupIndex {
+ public:
+  explicit RobotsGroupIndex(absl::string_view robots_body);
+
+  // Returns the number of groups in the robots.txt.
+  size_t num_groups() const { return groups_.size(); }
+
+ private:
+  friend class RobotsMatcherBase;
+  class Builder;
+
+  // A group and the lines it spans, up to the first line of the next group.
+  struct Group {
+    absl::string_view lines;
+    // The number of the first line, a user-agent line.
+    int first_line = 0;
+    bool is_global = false;
+    std::vector<std::string> user_agents;
+  };
+
+  // Returns true if 'group' applies to any of the 'user_agents'.
+  static bool Applies(const Group& group, const UserAgentSet& user_agents);
+
+  std::vector<Group> groups_;
+};
+
+// The outcome of matching one URL against a robots.txt.
+struct RobotsVerdict {
+  // True iff the URL is allowed, see RobotsMatcher::disallow().
+  bool allowed = true;
+  // The line that decided the verdict or 0 if none matched, see
+  // RobotsMatcher::matching_line().
+  int matching_line = 0;
+};
+
+// What a robots.txt decides for all the URLs of a host at once, for some user
+// agents.
+enum class HostVerdict {
+  // The verdict depends on the URL.
+  PER_URL = 0,
+  // Every URL is allowed.
+  ALLOW_ALL = 1,
+  // Every URL is disallowed.
+  DISALLOW_ALL = 2,
+};
+
+// CompiledRobots - a robots.txt parsed once into its groups and rules.
+//
+// RobotsMatcher parses the whole robots.txt body again for every URL it checks.
+// When many URLs are checked against the same robots.txt, it's cheaper to
+// build a CompiledRobots once and query it instead. The verdicts are identical
+// to the ones of RobotsMatcher::AllowedByRobots() for the same robots.txt body,
+// user agents and URL.
+//
+// A CompiledRobots doesn't keep a reference to the body it was built from.
+//
+// A CompiledRobots is immutable once constructed and all the state of a check
+// lives on the stack of the calling thread, so any number of threads may query
+// the same instance concurrently without synchronization. Use Create() to share
+// a single instance per robots.txt, e.g. between the workers of a fetcher.
+class CompiledRobots {
+ public:
+  // Parses 'robots_body' and stores its groups and (escaped) patterns.
+  explicit CompiledRobots(absl::string_view robots_body);
+  // Same, parsing no more of 'robots_body' than the 'limits' allow.
+  CompiledRobots(absl::string_view robots_body,
+                 const RobotsParseLimits& limits);
+
+  // Returns a CompiledRobots for 'robots_body' that can be shared between
+  // threads.
+  static std::shared_ptr<const CompiledRobots> Create(
+      absl::string_view robots_body);
+  static std::shared_ptr<const CompiledRobots> Create(
+      absl::string_view robots_body, const RobotsParseLimits& limits);
+
+  // Returns what was parsed of the robots.txt.
+  const RobotsParseReport& parse_report() const { return parse_report_; }
+
+  // Returns the verdict for all URLs of the host for the user agents, or
+  // PER_URL if the URLs have to be checked one by one. Unless it's PER_URL,
+  // IsAllowed() and AllowedByRobots() answer without looking at the URL.
+  HostVerdict GetHostVerdict(absl::string_view user_agent) const;
+  HostVerdict GetHostVerdict(const std::vector<std::string>& user_agents) const;
+  HostVerdict GetHostVerdict(
+      absl::Span<const absl::string_view> user_agents) const;
+
+  // Returns true iff every URL is allowed, respectively disallowed, to every
+  // user agent, whether the robots.txt names it or not.
+  bool allows_all() const { return allows_all_; }
+  bool disallows_all() const { return disallows_all_; }
+
+  // Returns a number naming the groups that apply to 'user_agent', or -1 for
+  // the global groups if none names it. User agents with the same number get
+  // the same verdict for every URL, as "FooBot" and "foobot" do, or all the
+  // user agents the robots.txt doesn't name. User agents aren't reduced to
+  // their product token: "FooBot/2.1" doesn't name "FooBot".
+  int GetUserAgentId(absl::string_view user_agent) const;
+
+  // Sets 'decisive_path' to the part of the path of 'url' deciding its
+  // verdict for 'user_agent': all URLs with the same decisive path get the
+  // same verdict and matching line. Patterns without a '*' before their end
+  // only look at as many bytes of the path as they're long, so the decisive
+  // path is the path up to the length of the longest of them that applies.
+  // Returns false if the whole path can matter, as for "/*.pdf". 'buffer'
+  // holds the decisive path if needed.
+  bool GetDecisivePath(absl::string_view user_agent, absl::string_view url,
+                       std::string* buffer,
+                       absl::string_view* decisive_path) const;
+
+  // Returns the approximate number of bytes used by this object, including
+  // itself.
+  size_t MemoryUsage() const;
+
+  // Returns the rules in the flat binary format read in place by
+  // CompiledRobotsView.
+  std::string Serialize() const;
+
+  // Returns true iff 'url' is allowed to be fetched by 'user_agent'. 'url' must
+  // be %-encoded according to RFC3986.
+  bool IsAllowed(absl::string_view user_agent, absl::string_view url) const;
+
+  // Returns true iff 'url' is allowed to be fetched by any member of the
+  // "user_agents" vector. 'url' must be %-encoded according to RFC3986.
+  bool AllowedByRobots(const std::vector<std::string>& user_agents,
+                       absl::string_view url) const;
+  bool AllowedByRobots(absl::Span<const absl::string_view> user_agents,
+                       absl::string_view url) const;
+
+  // Same as above, also returning the line that decided the verdict.
+  RobotsVerdict Evaluate(absl::string_view user_agent,
+                         absl::string_view url) const;
+  RobotsVerdict Evaluate(const std::vector<std::string>& user_agents,
+                         absl::string_view url) const;
+  RobotsVerdict Evaluate(absl::Span<const absl::string_view> user_agents,
+                         absl::string_view url) const;
+
+  // Returns the verdict for each of the 'user_agents' on its own, in the same
+  // order, as if each was checked with Evaluate(). Each group is matched
+  // against the URL at most once.
+  std::vector<RobotsVerdict> EvaluatePerAgent(
+      const std::vector<std::string>& user_agents, absl::string_view url) const;
+
+  // Returns the verdicts for all 'urls', in the same order.
+  std::vector<RobotsVerdict> EvaluateBatch(
+      const std::vector<std::string>& user_agents,
+      absl::Span<const absl::string_view> urls) const;
+
+ private:
+  class Builder;
+  friend class CompiledRobotsView;
+
+  // An Allow or Disallow pattern and the line it was found on.
+  struct Rule {
+    Rule(std::string pattern, int line)
+        : pattern(std::move(pattern)),
+          kind(GetPatternKind(this->pattern)),
+          line(line) {
+      if (kind == PatternKind::WILDCARD &&
+          WildcardPattern::Fits(this->pattern)) {
+        wildcard = std::make_unique<const WildcardPattern>(this->pattern);
+      }
+    }
+
+    std::string pattern;
+    PatternKind kind;
+    int line;
+    // The pattern prepared for matching, for WILDCARD patterns that fit.
+    std::unique_ptr<const WildcardPattern> wildcard;
+  };
+
+  // A node of the trie holding the literal patterns of a group, see
+  // GetPatternKind(). The patterns ending at a node are as long as the depth
+  // of the node, plus one for a trailing '$'. Lines are 0 if no such pattern.
+  struct TrieNode {
+    char label = 0;
+    int first_child = -1;
+    int next_sibling = -1;
+    int allow_line = 0;              // Earliest LITERAL Allow ending here.
+    int disallow_line = 0;           // Earliest LITERAL Disallow ending here.
+    int anchored_allow_line = 0;     // Same for LITERAL_END_ANCHORED.
+    int anchored_disallow_line = 0;
+  };
+
+  // The kinds of rules found in some groups, telling whether their verdict
+  // depends on the URL at all.
+  struct RuleSummary {
+    bool has_allow = false;     // Some Allow pattern isn't empty.
+    bool has_disallow = false;  // Some Disallow pattern isn't empty.
+    bool disallows_all = false;  // Some Disallow pattern matches any path.
+    // The number of bytes of a path the patterns look at, or npos if there's
+    // no bound.
+    size_t decisive_length = 0;
+
+    void Add(const RuleSummary& other);
+    HostVerdict verdict() const;
+    // The fields as bits 0 to 2 of an integer, as stored by Serialize().
+    uint32_t ToBits() const;
+    static RuleSummary FromBits(uint32_t bits);
+  };
+
+  // The rules following a sequence of user-agent lines.
+  struct Group {
+    bool is_global = false;               // True if one of the agents is '*'.
+    std::vector<std::string> user_agents;  // As by ExtractUserAgent().
+    std::vector<Rule> allow;               // In the order of the file.
+    std::vector<Rule> disallow;
+
+    // Index of the rules above, built once all rules are known. Literal
+    // patterns are all matched in one walk down the trie, the indices of the
+    // wildcard patterns in 'allow' and 'disallow' are matched one by one, the
+    // longest first.
+    std::vector<TrieNode> literal_trie;
+    std::vector<int> wildcard_allow;
+    std::vector<int> wildcard_disallow;
+    RuleSummary summary;
+  };
+
+  // Builds the trie and wildcard indices of 'group'.
+  static void IndexGroup(Group* group);
+
+  // Sets 'allow' and 'disallow' to the longest matches of 'path' among the
+  // rules of 'group', breaking ties with the earliest line as RobotsMatcher.
+  static void MatchGroup(const Group& group, absl::string_view path,
+                         RobotsMatcher::Match* allow,
+                         RobotsMatcher::Match* disallow);
+
+  template <typename UserAgents>
+  RobotsVerdict EvaluatePath(const UserAgents& user_agents,
+                             absl::string_view path) const;
+  template <typename UserAgents>
+  HostVerdict HostVerdictFor(const UserAgents& user_agents) const;
+
+  // Builds the indexes of the groups below.
+  void IndexUserAgents();
+
+  std::vector<Group> groups_;
+  // The user agents named by groups. For each of them, the indexes of the
+  // groups naming it, in file order.
+  UserAgentSet group_user_agents_;
+  std::vector<std::vector<int>> groups_by_user_agent_;
+  // The indexes of the global groups, in file order.
+  std::vector<int> global_groups_;
+  // The summaries of the groups naming each user agent above, and of the
+  // global groups.
+  std::vector<RuleSummary> summary_by_user_agent_;
+  RuleSummary global_summary_;
+  bool allows_all_ = true;
+  bool disallows_all_ = true;
+  RobotsParseReport parse_report_;
+};
+
+// CompiledRobotsView - compiled rules read in place from their flat binary
+// format, see CompiledRobots::Serialize().
+//
+// The format holds the groups, the user agents they name, and the patterns of
+// their rules with their lines, indexed as in CompiledRobots: the literal
+// patterns of a group are a trie, its wildcard patterns are sorted longest
+// first. All offsets are relative to the start of the data and all integers
+// are little-endian, so the data can be written to a file and mapped back into
+// memory at any address. Creating a view only checks that the data is
+// well-formed, which doesn't allocate. The verdicts are identical to the ones
+// of the CompiledRobots that was serialized.
+//
+// The data must outlive the view. Views are cheap to copy and thread-safe.
+class CompiledRobotsView {
+ public:
+  // The version of the format written by CompiledRobots::Serialize(). Views of
+  // data in other versions are invalid.
+  static constexpr uint32_t kFormatVersion = 1;
+
+  // An invalid view.
+  CompiledRobotsView() = default;
+  // A view of 'data', which is invalid if 'data' isn't well-formed. Checking
+  // 'data' reads all of it, which costs more than a check of a URL.
+  explicit CompiledRobotsView(absl::string_view data);
+  // A view of 'data' already accepted by a view, as by the line above, which
+  // only checks its header. 'data' must not have changed since.
+  static CompiledRobotsView Unchecked(absl::string_view data);
+
+  // Returns true iff the data of the view is well-formed. Invalid views
+  // behave as the rules of an empty robots.txt, allowing everything.
+  bool valid() const { return !data_.empty(); }
+
+  // Same as the CompiledRobots methods.
+  bool IsAllowed(absl::string_view user_agent, absl::string_view url) const;
+  bool AllowedByRobots(absl::Span<const absl::string_view> user_agents,
+                       absl::string_view url) const;
+  RobotsVerdict Evaluate(absl::string_view user_agent,
+                         absl::string_view url) const;
+  RobotsVerdict Evaluate(absl::Span<const absl::string_view> user_agents,
+                         absl::string_view url) const;
+  HostVerdict GetHostVerdict(absl::string_view user_agent) const;
+  HostVerdict GetHostVerdict(
+      absl::Span<const absl::string_view> user_agents) const;
+  bool allows_all() const;
+  bool disallows_all() const;
+
+ private:
+  // Returns the little-endian integer at 'offset' of the data.
+  uint32_t Read(size_t offset) const;
+  // Returns the index of the user agent record of 'user_agent', or -1.
+  int FindUserAgent(absl::string_view user_agent) const;
+  // Returns true iff the header of the data is well-formed.
+  bool ValidateHeader() const;
+  // Returns true iff the data is well-formed, assuming the header is.
+  bool Validate() const;
+  // Sets 'allow' and 'disallow' to the longest matches of 'path' among the
+  // rules of the group record 'group'.
+  void MatchGroup(uint32_t group, absl::string_view path,
+                  RobotsMatcherBase::Match* allow,
+                  RobotsMatcherBase::Match* disallow) const;
+  RobotsVerdict EvaluatePath(absl::Span<const absl::string_view> user_agents,
+                             absl::string_view path) const;
+
+  absl::string_view data_;
+};
+
+// Checks 'url' against the robots.txt for each of the 'user_agents' on its
+// own, parsing 'robots_body' only once. Returns one verdict per user agent, in
+// the same order. Unlike RobotsMatcher::AllowedByRobots(), the user agents
+// aren't merged into a single verdict. 'url' must be %-encoded according to
+// RFC3986.
+std::vector<RobotsVerdict> AllowedByRobotsPerAgent(
+    absl::string_view robots_body, const std::vector<std::string>& user_agents,
+    absl::string_view url);
+
+// Checks all 'urls' against the same robots.txt for the given user agents,
+// parsing 'robots_body' only once. Returns one verdict per URL, in the same
+// order. The URLs must be %-encoded according to RFC3986.
+std::vector<RobotsVerdict> AllowedByRobotsBatch(
+    absl::string_view robots_body, const std::vector<std::string>& user_agents,
+    absl::Span<const absl::string_view> urls);
+
 }  // namespace googlebot
 #endif  // THIRD_PARTY_ROBOTSTXT_ROBOTS_H__
@@ -0,0 +1,81 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_allocation_counter.cc
+// -----------------------------------------------------------------------------
+//
+// Replaces the global operator new and operator delete with ones counting the
+// allocations.
+//
+// All the forms allocating with malloc() are replaced together, so that each
+// pointer is freed by the counterpart of the form that allocated it. They
+// live in a file of their own, so that the compiler never sees a new
+// expression and the free() of its pointer at once, and mistakes them for a
+// mismatched pair. The over-aligned forms are left alone: they allocate and
+// free with their own functions.
+
+#include "robots_allocation_counter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<int64_t> num_allocations(0);
+
+// Allocates and counts 'size' bytes. Returns nullptr on failure.
+void* Allocate(size_t size) noexcept {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+// Allocates and counts 'size' bytes. Throws std::bad_alloc on failure.
+void* AllocateOrThrow(size_t size) {
+  void* const ptr = Allocate(size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+}  // namespace
+
+namespace googlebot {
+
+int64_t NumAllocations() {
+  return num_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace googlebot
+
+void* operator new(size_t size) { return AllocateOrThrow(size); }
+void* operator new[](size_t size) { return AllocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
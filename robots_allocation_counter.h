@@ -0,0 +1,38 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_allocation_counter.h
+// -----------------------------------------------------------------------------
+//
+// A count of the heap allocations of a binary, for tests and benchmarks
+// checking that a code path doesn't allocate.
+//
+// Linking robots_allocation_counter.cc into a binary replaces the global
+// operator new and operator delete of the binary with ones counting the
+// allocations. It must be linked into tests and benchmarks only.
+
+#ifndef THIRD_PARTY_ROBOTSTXT_ROBOTS_ALLOCATION_COUNTER_H_
+#define THIRD_PARTY_ROBOTSTXT_ROBOTS_ALLOCATION_COUNTER_H_
+
+#include <cstdint>
+
+namespace googlebot {
+
+// Returns the number of calls to the replaceable global operator new, in all
+// threads, since the binary started. Over-aligned allocations aren't counted.
+int64_t NumAllocations();
+
+}  // namespace googlebot
+#endif  // THIRD_PARTY_ROBOTSTXT_ROBOTS_ALLOCATION_COUNTER_H_
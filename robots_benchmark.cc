@@ -0,0 +1,753 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_benchmark.cc
+// -----------------------------------------------------------------------------
+//
+// Benchmarks for the robots.txt parser and matchers.
+//
+// By default the benchmarks run on a built-in robots.txt modeled after the
+// ones of large e-commerce and news sites. Set ROBOTS_BENCHMARK_CORPUS to the
+// path of a robots.txt file to run them on that file instead; they abort if it
+// can't be read.
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "robots.h"
+#include "robots_allocation_counter.h"
+#include "robots_cache.h"
+#include "robots_snapshot.h"
+
+// Internal functions, available to the linker but not in the header.
+namespace googlebot {
+bool MatchesPositionSet(absl::string_view path, absl::string_view pattern);
+bool MatchesBitParallel(absl::string_view path, absl::string_view pattern);
+}  // namespace googlebot
+
+namespace {
+
+std::string BuiltinRobotsTxt() {
+  std::string robotstxt =
+      "# Crawlers, please be nice.\n"
+      "User-agent: *\n"
+      "Disallow: /account/\n"
+      "Disallow: /cart\n"
+      "Disallow: /checkout/\n"
+      "Disallow: /search\n"
+      "Disallow: /*?sort=\n"
+      "Disallow: /*&sort=\n"
+      "Disallow: /*?sessionid=\n"
+      "Disallow: /*.json$\n"
+      "Disallow: /api/\n"
+      "Allow: /api/public/\n"
+      "Disallow: /private*/\n"
+      "Allow: /search/about\n"
+      "Disallow: /tmp/\n"
+      "Disallow: /print/\n"
+      "Allow: /*.css$\n"
+      "Allow: /*.js$\n"
+      "\n"
+      "User-agent: Googlebot\n"
+      "User-agent: Googlebot-Image\n"
+      "Disallow: /cart\n"
+      "Disallow: /checkout/\n"
+      "Disallow: /*?sessionid=\n"
+      "Allow: /search/about\n"
+      "\n"
+      "User-agent: BadBot\n"
+      "Disallow: /\n"
+      "\n"
+      "Sitemap: https://www.example.com/sitemap.xml\n";
+  // Sites often list many product categories and campaign pages.
+  for (int i = 0; i < 150; ++i) {
+    absl::StrAppend(&robotstxt, "User-agent: Bot", i, "\n", "Disallow: /c/", i,
+                    "/filter/\n", "Disallow: /promo/", i, "/*.html$\n",
+                    "Allow: /c/", i, "/\n");
+  }
+  absl::StrAppend(&robotstxt, "User-agent: *\n");
+  for (int i = 0; i < 200; ++i) {
+    absl::StrAppend(&robotstxt, "Disallow: /category/", i, "/internal/\n");
+  }
+  return robotstxt;
+}
+
+const std::string& Corpus() {
+  static const std::string* const corpus = []() {
+    const char* const path = std::getenv("ROBOTS_BENCHMARK_CORPUS");
+    if (path == nullptr) return new std::string(BuiltinRobotsTxt());
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::stringstream contents;
+    // Benchmarking an empty robots.txt instead would go unnoticed, so an
+    // empty file is an error too.
+    if (!file.is_open() || !(contents << file.rdbuf())) {
+      std::cerr << "failed to read file \"" << path << "\"" << std::endl;
+      std::abort();
+    }
+    return new std::string(contents.str());
+  }();
+  return *corpus;
+}
+
+const std::vector<std::string>& Urls() {
+  static const std::vector<std::string>* const urls = []() {
+    auto* urls = new std::vector<std::string>();
+    for (int i = 0; i < 64; ++i) {
+      for (const char* path :
+           {"/", "/index.html", "/cart", "/search?q=shoes",
+            "/category/12/shoes?sort=price&page=3", "/api/public/v1/items.json",
+            "/static/site.css", "/products/item-123.html?sessionid=abc",
+            "/account/orders"}) {
+        urls->push_back(absl::StrCat("https://www.example.com/c/", i, path));
+        urls->push_back(absl::StrCat("https://www.example.com", path));
+      }
+    }
+    return urls;
+  }();
+  return *urls;
+}
+
+// Returns the path part of the URLs, as passed to the pattern matchers.
+std::vector<std::string> Paths() {
+  std::vector<std::string> paths;
+  for (const std::string& url : Urls()) {
+    paths.push_back(url.substr(url.find('/', strlen("https://"))));
+  }
+  return paths;
+}
+
+// Returns the Allow and Disallow patterns of the corpus of the given kind.
+class PatternCollector : public googlebot::RobotsParseHandler {
+ public:
+  explicit PatternCollector(googlebot::PatternKind kind) : kind_(kind) {}
+
+  void HandleRobotsStart() override {}
+  void HandleRobotsEnd() override {}
+  void HandleUserAgent(int line_num, absl::string_view value) override {}
+  void HandleAllow(int line_num, absl::string_view value) override {
+    Collect(value);
+  }
+  void HandleDisallow(int line_num, absl::string_view value) override {
+    Collect(value);
+  }
+  void HandleSitemap(int line_num, absl::string_view value) override {}
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {}
+
+  const std::vector<std::string>& patterns() const { return patterns_; }
+
+ private:
+  void Collect(absl::string_view value) {
+    if (googlebot::GetPatternKind(value) == kind_) {
+      patterns_.emplace_back(value);
+    }
+  }
+
+  const googlebot::PatternKind kind_;
+  std::vector<std::string> patterns_;
+};
+
+// Ignores everything, to measure the parser alone.
+class NullHandler : public googlebot::RobotsParseHandler {
+ public:
+  void HandleRobotsStart() override {}
+  void HandleRobotsEnd() override {}
+  void HandleUserAgent(int line_num, absl::string_view value) override {}
+  void HandleAllow(int line_num, absl::string_view value) override {}
+  void HandleDisallow(int line_num, absl::string_view value) override {}
+  void HandleSitemap(int line_num, absl::string_view value) override {}
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {}
+};
+
+std::vector<std::string> Patterns(googlebot::PatternKind kind) {
+  PatternCollector collector(kind);
+  googlebot::ParseRobotsTxt(Corpus(), &collector);
+  return collector.patterns();
+}
+
+// Reparses the robots.txt for every URL.
+void BM_RobotsMatcher_OneAgentAllowedByRobots(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  const std::vector<std::string>& urls = Urls();
+  googlebot::RobotsMatcher matcher;
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher.OneAgentAllowedByRobots(
+        robotstxt, "Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_RobotsMatcher_OneAgentAllowedByRobots);
+
+// Same, calling the default match strategy through its virtual methods.
+void BM_RobotsMatcher_DynamicStrategy(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  const std::vector<std::string>& urls = Urls();
+  googlebot::BasicRobotsMatcher<googlebot::DynamicRobotsMatchStrategy> matcher(
+      googlebot::DynamicRobotsMatchStrategy(
+          std::make_unique<googlebot::LongestMatchRobotsMatchStrategy>()));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher.OneAgentAllowedByRobots(
+        robotstxt, "Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_RobotsMatcher_DynamicStrategy);
+
+// Parses only the groups that apply to the user agent for every URL.
+void BM_RobotsMatcher_GroupIndex(benchmark::State& state) {
+  const googlebot::RobotsGroupIndex robots(Corpus());
+  const std::vector<std::string>& urls = Urls();
+  googlebot::RobotsMatcher matcher;
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher.OneAgentAllowedByRobots(
+        robots, "Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_RobotsMatcher_GroupIndex);
+
+// A robots.txt with 500 user-agent lines, and the dozens of aliases a crawler
+// may check it for.
+std::string ManyUserAgentsRobotsTxt() {
+  std::string robotstxt;
+  for (int i = 0; i < 250; ++i) {
+    absl::StrAppend(&robotstxt, "User-agent: Bot", i, "\nUser-agent: Crawler",
+                    i, "\nDisallow: /bot/", i, "/\n\n");
+  }
+  absl::StrAppend(&robotstxt, "User-agent: *\nDisallow: /private/\n");
+  return robotstxt;
+}
+
+std::vector<absl::string_view> UserAgentAliases() {
+  static const std::vector<std::string>* const aliases = []() {
+    auto* aliases = new std::vector<std::string>();
+    for (int i = 0; i < 40; ++i) aliases->push_back(absl::StrCat("MyBot", i));
+    aliases->push_back("Crawler123");
+    return aliases;
+  }();
+  return std::vector<absl::string_view>(aliases->begin(), aliases->end());
+}
+
+void BM_RobotsMatcher_ManyUserAgents(benchmark::State& state) {
+  const std::string robotstxt = ManyUserAgentsRobotsTxt();
+  const std::vector<absl::string_view> user_agents = UserAgentAliases();
+  googlebot::RobotsMatcher matcher;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher.AllowedByRobots(
+        robotstxt, user_agents, "https://www.example.com/bot/123/"));
+  }
+}
+BENCHMARK(BM_RobotsMatcher_ManyUserAgents);
+
+void BM_CompiledRobots_ManyUserAgents(benchmark::State& state) {
+  const googlebot::CompiledRobots robots(ManyUserAgentsRobotsTxt());
+  const std::vector<absl::string_view> user_agents = UserAgentAliases();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(robots.AllowedByRobots(
+        user_agents, "https://www.example.com/bot/123/"));
+  }
+}
+BENCHMARK(BM_CompiledRobots_ManyUserAgents);
+
+// Parses the robots.txt once, outside of the timed loop.
+void BM_CompiledRobots_IsAllowed(benchmark::State& state) {
+  const googlebot::CompiledRobots robots(Corpus());
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        robots.IsAllowed("Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_CompiledRobots_IsAllowed);
+
+// A robots.txt disallowing everything, which needs no look at the URL.
+void BM_CompiledRobots_DisallowAll(benchmark::State& state) {
+  const googlebot::CompiledRobots robots("User-agent: *\nDisallow: /\n");
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        robots.IsAllowed("Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_CompiledRobots_DisallowAll);
+
+// A group with hundreds of wildcard rules, most of them matching few paths.
+void BM_CompiledRobots_ManyWildcards(benchmark::State& state) {
+  std::string robotstxt = "User-agent: *\nDisallow: /*.php\nAllow: /*/\n";
+  for (int i = 0; i < 300; ++i) {
+    absl::StrAppend(&robotstxt, "Disallow: /*/", i, "/*.pdf$\n",
+                    "Allow: /*/", i, "/*?page=*\n");
+  }
+  const googlebot::CompiledRobots robots(robotstxt);
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        robots.IsAllowed("Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_CompiledRobots_ManyWildcards);
+
+// Checks a few hundred links discovered on one host, one by one.
+void BM_OneAgentAllowedByRobotsLoop(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  const std::vector<std::string>& urls = Urls();
+  const size_t num_urls = std::min<size_t>(state.range(0), urls.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < num_urls; ++i) {
+      googlebot::RobotsMatcher matcher;
+      benchmark::DoNotOptimize(
+          matcher.OneAgentAllowedByRobots(robotstxt, "Googlebot", urls[i]));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_urls);
+}
+BENCHMARK(BM_OneAgentAllowedByRobotsLoop)->Arg(10)->Arg(300);
+
+// Same, with all the links in a single call.
+void BM_AllowedByRobotsBatch(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  const std::vector<std::string>& urls = Urls();
+  const size_t num_urls = std::min<size_t>(state.range(0), urls.size());
+  const std::vector<absl::string_view> batch(urls.begin(),
+                                             urls.begin() + num_urls);
+  const std::vector<std::string> user_agents = {"Googlebot"};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        googlebot::AllowedByRobotsBatch(robotstxt, user_agents, batch));
+  }
+  state.SetItemsProcessed(state.iterations() * num_urls);
+}
+BENCHMARK(BM_AllowedByRobotsBatch)->Arg(10)->Arg(300);
+
+// Classifies the keys of directives: every spelling that is accepted, in
+// different cases, and directives that aren't supported.
+void BM_GetKeyType(benchmark::State& state) {
+  const std::vector<std::string> keys = {
+      "user-agent", "User-Agent", "USER-AGENT", "useragent",   "user agent",
+      "allow",      "Allow",      "disallow",   "Disallow",    "DISALLOW",
+      "dissallow",  "dissalow",   "disalow",    "diasllow",    "disallaw",
+      "sitemap",    "Sitemap",    "site-map",   "crawl-delay", "Crawl-delay",
+      "host",       "noindex",    "clean-param", "request-rate", "a",
+  };
+  for (auto _ : state) {
+    for (const std::string& key : keys) {
+      bool is_acceptable_typo;
+      benchmark::DoNotOptimize(
+          googlebot::GetKeyType(key, &is_acceptable_typo));
+      benchmark::DoNotOptimize(is_acceptable_typo);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_GetKeyType);
+
+// Parses with a new context every time, or with the same one if
+// 'state.range(0)' is set. Reports the number of allocations per parse.
+void BM_ParseRobotsTxt(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  const bool reuse_context = state.range(0) != 0;
+  NullHandler handler;
+  googlebot::RobotsParseContext reused_context;
+  googlebot::ParseRobotsTxt(robotstxt, &handler, &reused_context);
+  const int64_t num_allocations_before = googlebot::NumAllocations();
+  for (auto _ : state) {
+    if (reuse_context) {
+      googlebot::ParseRobotsTxt(robotstxt, &handler, &reused_context);
+    } else {
+      googlebot::RobotsParseContext context;
+      googlebot::ParseRobotsTxt(robotstxt, &handler, &context);
+    }
+  }
+  state.counters["allocs_per_parse"] = benchmark::Counter(
+      googlebot::NumAllocations() - num_allocations_before,
+      benchmark::Counter::kAvgIterations);
+  state.SetBytesProcessed(state.iterations() * robotstxt.size());
+}
+BENCHMARK(BM_ParseRobotsTxt)->ArgName("reuse_context")->Arg(0)->Arg(1);
+
+// A multi-megabyte robots.txt as generated by some CMSes, with one rule per
+// page and long lines.
+void BM_ParseLargeRobotsTxt(benchmark::State& state) {
+  std::string robotstxt = "User-agent: *\r\n";
+  for (int i = 0; robotstxt.size() < (4 << 20); ++i) {
+    absl::StrAppend(&robotstxt, "Disallow: /content/articles/", i,
+                    "/comments/page-", i % 97, "/reply?replytocom=", i * 31,
+                    "&utm_source=newsletter\r\n");
+    if (i % 100 == 0) {
+      absl::StrAppend(&robotstxt, "# ", std::string(500, '-'), "\r\n\r\n");
+    }
+  }
+  NullHandler handler;
+  googlebot::RobotsParseContext context;
+  for (auto _ : state) {
+    googlebot::ParseRobotsTxt(robotstxt, &handler, &context);
+  }
+  state.SetBytesProcessed(state.iterations() * robotstxt.size());
+}
+BENCHMARK(BM_ParseLargeRobotsTxt);
+
+void BM_CompiledRobots_Build(benchmark::State& state) {
+  const std::string& robotstxt = Corpus();
+  for (auto _ : state) {
+    googlebot::CompiledRobots robots(robotstxt);
+    benchmark::DoNotOptimize(&robots);
+  }
+  state.SetBytesProcessed(state.iterations() * robotstxt.size());
+}
+BENCHMARK(BM_CompiledRobots_Build);
+
+// Opening serialized rules only validates them, compare with building them.
+void BM_CompiledRobotsView_Open(benchmark::State& state) {
+  const std::string serialized =
+      googlebot::CompiledRobots(Corpus()).Serialize();
+  for (auto _ : state) {
+    googlebot::CompiledRobotsView view(serialized);
+    benchmark::DoNotOptimize(&view);
+  }
+  state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_CompiledRobotsView_Open);
+
+void BM_CompiledRobotsView_IsAllowed(benchmark::State& state) {
+  const std::string serialized =
+      googlebot::CompiledRobots(Corpus()).Serialize();
+  const googlebot::CompiledRobotsView view(serialized);
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        view.IsAllowed("Googlebot", urls[i++ % urls.size()]));
+  }
+}
+BENCHMARK(BM_CompiledRobotsView_IsAllowed);
+
+// Matches every pattern of the given kind against every path with 'matches'.
+template <bool (*matches)(absl::string_view, absl::string_view)>
+void BM_MatchPatterns(benchmark::State& state) {
+  const std::vector<std::string> patterns =
+      Patterns(static_cast<googlebot::PatternKind>(state.range(0)));
+  const std::vector<std::string> paths = Paths();
+  for (auto _ : state) {
+    for (const std::string& path : paths) {
+      for (const std::string& pattern : patterns) {
+        benchmark::DoNotOptimize(matches(path, pattern));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size() * patterns.size());
+}
+
+// Wildcard patterns that must scan the whole of a long path.
+template <bool (*matches)(absl::string_view, absl::string_view)>
+void BM_MatchLongPath(benchmark::State& state) {
+  std::string path;
+  for (int i = 0; i < state.range(0); ++i) absl::StrAppend(&path, "/dir", i);
+  absl::StrAppend(&path, "/page.html?utm_source=newsletter&id=123");
+  // The last pattern has a literal prefix longer than the automaton could
+  // hold, which is compared as is.
+  const std::vector<std::string> patterns = {
+      "/*?sessionid=", "/*.json$", "/*/private*/", "/*.html*id=",
+      path.substr(0, std::min<size_t>(path.size() - 1, 80)) + "*?id="};
+  for (auto _ : state) {
+    for (const std::string& pattern : patterns) {
+      benchmark::DoNotOptimize(matches(path, pattern));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * patterns.size());
+}
+
+BENCHMARK_TEMPLATE(BM_MatchLongPath, googlebot::MatchesPositionSet)
+    ->Arg(4)
+    ->Arg(64);
+BENCHMARK_TEMPLATE(BM_MatchLongPath, googlebot::MatchesBitParallel)
+    ->Arg(4)
+    ->Arg(64);
+
+// Same as BM_MatchPatterns for the WILDCARD patterns, prepared once as the
+// rules of a CompiledRobots are.
+void BM_MatchPreparedPatterns(benchmark::State& state) {
+  std::vector<googlebot::WildcardPattern> patterns;
+  for (const std::string& pattern :
+       Patterns(googlebot::PatternKind::WILDCARD)) {
+    if (googlebot::WildcardPattern::Fits(pattern)) {
+      patterns.emplace_back(pattern);
+    }
+  }
+  const std::vector<std::string> paths = Paths();
+  for (auto _ : state) {
+    for (const std::string& path : paths) {
+      for (const googlebot::WildcardPattern& pattern : patterns) {
+        benchmark::DoNotOptimize(pattern.Matches(path));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size() * patterns.size());
+}
+BENCHMARK(BM_MatchPreparedPatterns);
+
+BENCHMARK_TEMPLATE(BM_MatchPatterns, googlebot::MatchesPositionSet)
+    ->Arg(static_cast<int>(googlebot::PatternKind::LITERAL))
+    ->Arg(static_cast<int>(googlebot::PatternKind::WILDCARD));
+BENCHMARK_TEMPLATE(BM_MatchPatterns, googlebot::MatchesBitParallel)
+    ->Arg(static_cast<int>(googlebot::PatternKind::LITERAL))
+    ->Arg(static_cast<int>(googlebot::PatternKind::WILDCARD));
+
+// The number of hosts in the cache of the lookup benchmarks.
+constexpr int kNumCachedHosts = 10000;
+
+const std::vector<std::string>& CachedHosts() {
+  static const auto* const hosts = []() {
+    auto* hosts = new std::vector<std::string>();
+    for (int i = 0; i < kNumCachedHosts; ++i) {
+      hosts->push_back(absl::StrCat("www.host", i, ".com"));
+    }
+    return hosts;
+  }();
+  return *hosts;
+}
+
+// Returns a cache of the rules of Corpus() for all of CachedHosts().
+const googlebot::RobotsCache& FullCache() {
+  static googlebot::RobotsCache* const cache = []() {
+    const googlebot::RobotsCache::Rules rules =
+        googlebot::CompiledRobots::Create(Corpus());
+    googlebot::RobotsCacheOptions options;
+    options.max_bytes = 2 * kNumCachedHosts * rules->MemoryUsage();
+    auto* cache = new googlebot::RobotsCache(options);
+    for (const std::string& host : CachedHosts()) cache->Put(host, rules);
+    return cache;
+  }();
+  return *cache;
+}
+
+// Looks up the rules of hosts, from 1 to as many threads as there are CPUs.
+void BM_RobotsCache_Get(benchmark::State& state) {
+  const std::vector<std::string>& hosts = CachedHosts();
+  const googlebot::RobotsCache& cache = FullCache();
+  size_t i = 7919 * state.thread_index();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cache.Get(hosts[i % hosts.size()]));
+    ++i;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RobotsCache_Get)
+    ->ThreadRange(1, benchmark::CPUInfo::Get().num_cpus)
+    ->UseRealTime();
+
+// Same, checking a URL against the rules looked up.
+void BM_RobotsCache_GetAndCheck(benchmark::State& state) {
+  const std::vector<std::string>& hosts = CachedHosts();
+  const googlebot::RobotsCache& cache = FullCache();
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 7919 * state.thread_index();
+  for (auto _ : state) {
+    const googlebot::RobotsCache::Rules rules =
+        cache.Get(hosts[i % hosts.size()]);
+    benchmark::DoNotOptimize(
+        rules->IsAllowed("Googlebot", urls[i % urls.size()]));
+    ++i;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RobotsCache_GetAndCheck)
+    ->ThreadRange(1, benchmark::CPUInfo::Get().num_cpus)
+    ->UseRealTime();
+
+// Fills an empty cache with the rules of many hosts, one Put() each.
+void BM_RobotsCache_Fill(benchmark::State& state) {
+  std::vector<std::string> hosts;
+  for (int i = 0; i < state.range(0); ++i) {
+    hosts.push_back(absl::StrCat("www.host", i, ".com"));
+  }
+  const googlebot::RobotsCache::Rules rules =
+      googlebot::CompiledRobots::Create(Corpus());
+  googlebot::RobotsCacheOptions options;
+  options.max_bytes = std::numeric_limits<size_t>::max();
+  for (auto _ : state) {
+    auto cache = std::make_unique<googlebot::RobotsCache>(options);
+    for (const std::string& host : hosts) cache->Put(host, rules);
+    state.PauseTiming();
+    cache.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * hosts.size());
+}
+BENCHMARK(BM_RobotsCache_Fill)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Fills a cache with the rules of many hosts serving a few distinct bodies,
+// as parked domains and CMS defaults do.
+void BM_RobotsCache_SharedBodies(benchmark::State& state) {
+  constexpr int kNumHosts = 1000;
+  constexpr int kNumBodies = 10;
+  std::vector<std::string> bodies;
+  for (int i = 0; i < kNumBodies; ++i) {
+    bodies.push_back(absl::StrCat(Corpus(), "Disallow: /template", i, "\n"));
+  }
+  std::vector<std::string> hosts;
+  for (int i = 0; i < kNumHosts; ++i) {
+    hosts.push_back(absl::StrCat("www.host", i, ".com"));
+  }
+  googlebot::RobotsCacheOptions options;
+  options.max_bytes = size_t{1} << 32;
+  googlebot::RobotsCacheStats stats;
+  for (auto _ : state) {
+    googlebot::RobotsCache cache(options);
+    for (int i = 0; i < kNumHosts; ++i) {
+      benchmark::DoNotOptimize(
+          cache.GetOrCompile(hosts[i], bodies[i % kNumBodies]));
+    }
+    stats = cache.stats();
+  }
+  state.SetItemsProcessed(state.iterations() * kNumHosts);
+  state.counters["dedup_ratio"] = stats.dedup_ratio();
+  state.counters["bytes_saved"] = stats.bytes_saved();
+}
+BENCHMARK(BM_RobotsCache_SharedBodies);
+
+// Finds a host among many in a snapshot and checks a URL against its rules.
+void BM_RobotsSnapshot_FindAndCheck(benchmark::State& state) {
+  const int num_hosts = state.range(0);
+  googlebot::RobotsSnapshotBuilder builder;
+  std::vector<std::string> hosts;
+  for (int i = 0; i < num_hosts; ++i) {
+    hosts.push_back(absl::StrCat("www.host", i, ".com"));
+    builder.Add(hosts.back(),
+                absl::StrCat("User-agent: *\nDisallow: /private", i % 1000,
+                             "/\nDisallow: /*.pdf$\nAllow: /private/public\n"));
+  }
+  const std::string data = builder.Build();
+  const googlebot::RobotsSnapshot snapshot(data);
+  size_t i = 0;
+  for (auto _ : state) {
+    // A stride spreading the lookups over the whole hash table.
+    i = (i + 7919) % hosts.size();
+    benchmark::DoNotOptimize(snapshot.Find(hosts[i]).IsAllowed(
+        "Googlebot", "https://www.example.com/private17/a.html"));
+  }
+  state.counters["bytes_per_host"] = static_cast<double>(data.size()) /
+                                     num_hosts;
+}
+BENCHMARK(BM_RobotsSnapshot_FindAndCheck)->Arg(1000)->Arg(1000000);
+
+// Same with the rules of real robots.txt files, which are read in full when
+// checked.
+void BM_RobotsSnapshot_FindAndCheckCorpus(benchmark::State& state) {
+  constexpr int kNumHosts = 1000;
+  constexpr int kNumBodies = 10;
+  std::vector<googlebot::CompiledRobots> bodies;
+  for (int i = 0; i < kNumBodies; ++i) {
+    bodies.emplace_back(absl::StrCat(Corpus(), "Disallow: /template", i, "\n"));
+  }
+  googlebot::RobotsSnapshotBuilder builder;
+  std::vector<std::string> hosts;
+  for (int i = 0; i < kNumHosts; ++i) {
+    hosts.push_back(absl::StrCat("www.host", i, ".com"));
+    builder.Add(hosts.back(), bodies[i % kNumBodies]);
+  }
+  const std::string data = builder.Build();
+  const googlebot::RobotsSnapshot snapshot(data);
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 0;
+  for (auto _ : state) {
+    i = (i + 7919) % hosts.size();
+    benchmark::DoNotOptimize(snapshot.Find(hosts[i]).IsAllowed(
+        "Googlebot", urls[i % urls.size()]));
+  }
+}
+BENCHMARK(BM_RobotsSnapshot_FindAndCheckCorpus);
+
+// Same through a LiveRobotsSnapshot, from several threads at once.
+void BM_LiveRobotsSnapshot_IsAllowed(benchmark::State& state) {
+  constexpr int kNumHosts = 1000;
+  static const auto* const hosts = []() {
+    auto* hosts = new std::vector<std::string>();
+    for (int i = 0; i < kNumHosts; ++i) {
+      hosts->push_back(absl::StrCat("www.host", i, ".com"));
+    }
+    return hosts;
+  }();
+  static const googlebot::LiveRobotsSnapshot* const live = []() {
+    googlebot::RobotsSnapshotBuilder builder;
+    for (int i = 0; i < kNumHosts; ++i) {
+      builder.Add((*hosts)[i], absl::StrCat(Corpus(), "Disallow: /private",
+                                            i % 10, "/\n"));
+    }
+    return new googlebot::LiveRobotsSnapshot(
+        googlebot::RobotsSnapshot::Create(builder.Build()));
+  }();
+  const std::vector<std::string>& urls = Urls();
+  size_t i = 7919 * state.thread_index();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(live->IsAllowed(
+        (*hosts)[i % kNumHosts], "Googlebot", urls[i % urls.size()]));
+    ++i;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LiveRobotsSnapshot_IsAllowed)
+    ->ThreadRange(1, benchmark::CPUInfo::Get().num_cpus)
+    ->UseRealTime();
+
+// Checks product URLs differing only in their query, directly against the
+// rules (range 0) or through a RobotsVerdictCache (range 1).
+void BM_RobotsVerdictCache_IsAllowed(benchmark::State& state) {
+  std::string robotstxt =
+      "User-agent: *\nDisallow: /cart/\nAllow: /cart/view\n";
+  for (int i = 0; i < 100; ++i) {
+    absl::StrAppend(&robotstxt, "Disallow: /product/", i, "/reviews\n",
+                    "Disallow: /search/", i, "*\n");
+  }
+  const googlebot::RobotsVerdictCache cache(
+      googlebot::CompiledRobots::Create(robotstxt));
+  std::vector<std::string> urls;
+  for (int i = 0; i < 10000; ++i) {
+    urls.push_back(absl::StrCat("https://www.example.com/product/", i % 200,
+                                "/reviews/page", i % 7, "?ref=", i));
+  }
+  const bool use_cache = state.range(0) != 0;
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& url = urls[i++ % urls.size()];
+    benchmark::DoNotOptimize(use_cache
+                                 ? cache.IsAllowed("Googlebot", url)
+                                 : cache.rules()->IsAllowed("Googlebot", url));
+  }
+  state.counters["hit_rate"] = cache.stats().hit_rate();
+}
+BENCHMARK(BM_RobotsVerdictCache_IsAllowed)->ArgName("cached")->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
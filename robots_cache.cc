@@ -0,0 +1,474 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_cache.cc
+// -----------------------------------------------------------------------------
+//
+// Implements the cache of compiled robots.txt rules per host.
+
+#include "robots_cache.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+
+namespace googlebot {
+
+RobotsCache::RobotsCache(const RobotsCacheOptions& options)
+    : options_(options),
+      max_shard_bytes_(options.max_bytes / std::max(1, options.num_shards)),
+      shards_(new Shard[std::max(1, options.num_shards)]) {
+  for (int i = 0; i < std::max(1, options_.num_shards); ++i) {
+    absl::MutexLock lock(&shards_[i].mu);
+    shards_[i].hand = shards_[i].entries.end();
+  }
+}
+
+/*static*/ size_t RobotsCache::HashKey(absl::string_view key) {
+  return absl::Hash<absl::string_view>()(key);
+}
+
+RobotsCache::Shard& RobotsCache::ShardFor(size_t hash) const {
+  // The high bits, as the tables of the shards use the low ones.
+  return shards_[(hash >> 32) % std::max(1, options_.num_shards)];
+}
+
+RobotsCache::Rules RobotsCache::Get(absl::string_view key) const {
+  const size_t hash = HashKey(key);
+  Rules rules = Lookup(ShardFor(hash), key, hash);
+  CountLookup(rules != nullptr);
+  return rules;
+}
+
+void RobotsCache::Put(absl::string_view key, Rules rules) {
+  const size_t hash = HashKey(key);
+  Shard& shard = ShardFor(hash);
+  {
+    absl::MutexLock lock(&shard.mu);
+    Insert(shard, key, hash, std::move(rules), /*content_hash=*/nullptr);
+  }
+  Reclaim(shard);
+}
+
+RobotsCache::Rules RobotsCache::GetOrCompile(absl::string_view key,
+                                             absl::string_view robots_body) {
+  const size_t hash = HashKey(key);
+  Shard& shard = ShardFor(hash);
+  if (Rules rules = Lookup(shard, key, hash)) {
+    CountLookup(/*hit=*/true);
+    return rules;
+  }
+
+  // Either join the compilation of another thread, or start one.
+  std::promise<Rules> promise;
+  std::shared_future<Rules> compilation;
+  {
+    absl::MutexLock lock(&shard.mu);
+    // Another thread may have compiled the rules since the lookup above.
+    if (Rules rules =
+            Find(*shard.table.load(std::memory_order_relaxed), key, hash)) {
+      CountLookup(/*hit=*/true);
+      return rules;
+    }
+    CountLookup(/*hit=*/false);
+    const auto in_flight = shard.in_flight.find(key);
+    if (in_flight != shard.in_flight.end()) {
+      compilation = in_flight->second;
+    } else {
+      shard.in_flight.emplace(std::string(key), promise.get_future().share());
+    }
+  }
+  if (compilation.valid()) return compilation.get();
+
+  const ContentHash content_hash = HashContent(robots_body);
+  Rules rules = FindByContent(content_hash);
+  if (rules != nullptr) {
+    interned_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    rules = CompiledRobots::Create(robots_body);
+    shard.compilations.fetch_add(1, std::memory_order_relaxed);
+  }
+  {
+    absl::MutexLock lock(&shard.mu);
+    Insert(shard, key, hash, rules, &content_hash);
+    shard.in_flight.erase(key);
+  }
+  promise.set_value(rules);
+  Reclaim(shard);
+  return rules;
+}
+
+void RobotsCache::Erase(absl::string_view key) {
+  Shard& shard = ShardFor(HashKey(key));
+  {
+    absl::MutexLock lock(&shard.mu);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) return;
+    Remove(shard, it->second);
+  }
+  Reclaim(shard);
+}
+
+RobotsCacheStats RobotsCache::stats() const {
+  RobotsCacheStats stats;
+  for (const LookupCounters& counters : lookup_counters_) {
+    stats.hits += counters.hits.load(std::memory_order_relaxed);
+    stats.misses += counters.misses.load(std::memory_order_relaxed);
+  }
+  for (int i = 0; i < std::max(1, options_.num_shards); ++i) {
+    const Shard& shard = shards_[i];
+    stats.compilations += shard.compilations.load(std::memory_order_relaxed);
+    stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+    stats.expirations += shard.expirations.load(std::memory_order_relaxed);
+    absl::ReaderMutexLock lock(&shard.mu);
+    stats.entries += shard.index.size();
+    stats.bytes += shard.bytes;
+  }
+  stats.interned = interned_.load(std::memory_order_relaxed);
+  absl::MutexLock lock(&rules_mu_);
+  stats.unique_rules = shared_rules_.size();
+  stats.rules_bytes = rules_bytes_;
+  stats.unique_rules_bytes = unique_rules_bytes_;
+  return stats;
+}
+
+/*static*/ RobotsCache::ContentHash RobotsCache::HashContent(
+    absl::string_view robots_body) {
+  // The second hash mixes in a salt first, which changes the seed of the hash
+  // of the bytes.
+  constexpr uint64_t kSalt = 0x9e3779b97f4a7c15ULL;
+  return {absl::Hash<absl::string_view>()(robots_body),
+          absl::Hash<std::pair<uint64_t, absl::string_view>>()(
+              std::make_pair(kSalt, robots_body))};
+}
+
+RobotsCache::Rules RobotsCache::FindByContent(
+    const ContentHash& content_hash) const {
+  absl::MutexLock lock(&rules_mu_);
+  const auto it = rules_by_content_.find(content_hash);
+  if (it == rules_by_content_.end()) return nullptr;
+  return shared_rules_.at(it->second).rules;
+}
+
+size_t RobotsCache::AcquireRules(const Rules& rules,
+                                 const ContentHash* content_hash) {
+  absl::MutexLock lock(&rules_mu_);
+  SharedRules& shared = shared_rules_[rules.get()];
+  if (shared.num_entries++ == 0) {
+    shared.rules = rules;
+    shared.bytes = rules->MemoryUsage();
+    unique_rules_bytes_ += shared.bytes;
+  }
+  rules_bytes_ += shared.bytes;
+  // Other rules may be known for the same body, if two keys compiled it at
+  // once. The first ones are kept.
+  if (content_hash != nullptr && !shared.has_content_hash &&
+      rules_by_content_.emplace(*content_hash, rules.get()).second) {
+    shared.has_content_hash = true;
+    shared.content_hash = *content_hash;
+  }
+  return shared.bytes;
+}
+
+void RobotsCache::ReleaseRules(const CompiledRobots* rules) {
+  absl::MutexLock lock(&rules_mu_);
+  const auto it = shared_rules_.find(rules);
+  SharedRules& shared = it->second;
+  rules_bytes_ -= shared.bytes;
+  if (--shared.num_entries > 0) return;
+  unique_rules_bytes_ -= shared.bytes;
+  if (shared.has_content_hash) rules_by_content_.erase(shared.content_hash);
+  shared_rules_.erase(it);
+}
+
+RobotsCache::Table::Table(size_t num_slots)
+    : mask_(num_slots - 1),
+      slots_(new std::atomic<const Entry*>[num_slots]) {
+  for (size_t i = 0; i < num_slots; ++i) {
+    slots_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+RobotsCache::Rules RobotsCache::Lookup(const Shard& shard,
+                                       absl::string_view key,
+                                       size_t hash) const {
+  const ReaderEpochs::ReadLock lock(shard.epochs);
+  return Find(*shard.table.load(std::memory_order_acquire), key, hash);
+}
+
+RobotsCache::Rules RobotsCache::Find(const Table& table, absl::string_view key,
+                                     size_t hash) const {
+  const Entry* const removed = Removed();
+  // Tables always have free slots, which end the probing.
+  for (size_t i = hash;; ++i) {
+    const Entry* const entry = table.slot(i).load(std::memory_order_acquire);
+    if (entry == nullptr) return nullptr;
+    if (entry == removed || entry->hash != hash || entry->key != key) continue;
+    if (entry->expiration != absl::InfiniteFuture() &&
+        entry->expiration <= options_.clock()) {
+      return nullptr;
+    }
+    // Entries are read by many threads at once, so only write the flag when
+    // it changes, which keeps its cache line shared.
+    if (!entry->referenced.load(std::memory_order_relaxed)) {
+      entry->referenced.store(true, std::memory_order_relaxed);
+    }
+    return entry->rules;
+  }
+}
+
+/*static*/ const RobotsCache::Entry* RobotsCache::Removed() {
+  static const Entry* const removed =
+      new Entry(std::string(), 0, nullptr, 0, absl::InfinitePast());
+  return removed;
+}
+
+void RobotsCache::CountLookup(bool hit) const {
+  LookupCounters& counters =
+      lookup_counters_[ThreadNumber() % kNumLookupCounters];
+  (hit ? counters.hits : counters.misses)
+      .fetch_add(1, std::memory_order_relaxed);
+}
+
+void RobotsCache::Insert(Shard& shard, absl::string_view key, size_t hash,
+                         Rules rules, const ContentHash* content_hash) {
+  const auto it = shard.index.find(key);
+  const size_t bytes =
+      sizeof(Entry) + key.size() + AcquireRules(rules, content_hash);
+  if (bytes > max_shard_bytes_) {
+    ReleaseRules(rules.get());
+    if (it != shard.index.end()) Remove(shard, it->second);
+    return;
+  }
+  const absl::Time now = options_.clock();
+  std::unique_ptr<const Entry> added(new Entry(
+      std::string(key), hash, std::move(rules), bytes, now + options_.ttl));
+  if (it != shard.index.end()) {
+    // Lookups see either the replaced entry or the new one, never neither.
+    SlotOf(shard, it->second->get())
+        .store(added.get(), std::memory_order_release);
+    Retire(shard, it->second);
+  } else {
+    AddToTable(shard, added.get());
+  }
+  // New entries go right behind the hand, to be visited last.
+  const auto entry = shard.entries.insert(shard.hand, std::move(added));
+  shard.index.emplace((*entry)->key, entry);
+  shard.bytes += bytes;
+
+  while (shard.bytes > max_shard_bytes_) {
+    if (shard.hand == shard.entries.end()) shard.hand = shard.entries.begin();
+    const Entry& candidate = **shard.hand;
+    if (candidate.expiration <= now) {
+      shard.expirations.fetch_add(1, std::memory_order_relaxed);
+      Remove(shard, shard.hand);
+    } else if (candidate.referenced.exchange(false,
+                                             std::memory_order_relaxed)) {
+      ++shard.hand;
+    } else {
+      shard.evictions.fetch_add(1, std::memory_order_relaxed);
+      Remove(shard, shard.hand);
+    }
+  }
+}
+
+void RobotsCache::Remove(Shard& shard, EntryList::iterator entry) {
+  SlotOf(shard, entry->get()).store(Removed(), std::memory_order_release);
+  Retire(shard, entry);
+}
+
+void RobotsCache::Retire(Shard& shard, EntryList::iterator entry) {
+  if (shard.hand == entry) ++shard.hand;
+  const Entry& removed = **entry;
+  shard.bytes -= removed.bytes;
+  ReleaseRules(removed.rules.get());
+  shard.index.erase(removed.key);
+  shard.retired.entries.push_back(std::move(*entry));
+  shard.entries.erase(entry);
+}
+
+/*static*/ std::atomic<const RobotsCache::Entry*>& RobotsCache::SlotOf(
+    const Shard& shard, const Entry* entry) {
+  const Table& table = *shard.table.load(std::memory_order_relaxed);
+  for (size_t i = entry->hash;; ++i) {
+    std::atomic<const Entry*>& slot = table.slot(i);
+    if (slot.load(std::memory_order_relaxed) == entry) return slot;
+  }
+}
+
+/*static*/ void RobotsCache::AddToTable(Shard& shard, const Entry* entry) {
+  // Keep at least half of the slots free, which keeps probing short.
+  if (2 * (shard.used_slots + 1) >
+      shard.table.load(std::memory_order_relaxed)->num_slots()) {
+    RebuildTable(shard);
+  }
+  const Table& table = *shard.table.load(std::memory_order_relaxed);
+  const Entry* const removed = Removed();
+  for (size_t i = entry->hash;; ++i) {
+    std::atomic<const Entry*>& slot = table.slot(i);
+    const Entry* const previous = slot.load(std::memory_order_relaxed);
+    if (previous == nullptr || previous == removed) {
+      if (previous == nullptr) ++shard.used_slots;
+      slot.store(entry, std::memory_order_release);
+      return;
+    }
+  }
+}
+
+/*static*/ void RobotsCache::RebuildTable(Shard& shard) {
+  // As many writes again as there are entries can go before the next
+  // rebuild, which takes as many steps.
+  size_t num_slots = kMinSlots;
+  while (num_slots < 4 * (shard.entries.size() + 1)) num_slots *= 2;
+  std::unique_ptr<Table> table(new Table(num_slots));
+  for (const std::unique_ptr<const Entry>& entry : shard.entries) {
+    size_t i = entry->hash;
+    while (table->slot(i).load(std::memory_order_relaxed) != nullptr) ++i;
+    table->slot(i).store(entry.get(), std::memory_order_relaxed);
+  }
+  shard.used_slots = shard.entries.size();
+  shard.retired.tables.emplace_back(
+      shard.table.exchange(table.release(), std::memory_order_release));
+}
+
+/*static*/ void RobotsCache::Reclaim(Shard& shard) {
+  // A writer finding another one at it leaves what it retired to the next
+  // call, rather than waiting for the readers twice.
+  if (!shard.reclaim_mu.TryLock()) return;
+  Retired retired;
+  {
+    absl::MutexLock lock(&shard.mu);
+    std::swap(retired, shard.retired);
+  }
+  // Lookups started from now on can't reach what was retired.
+  shard.epochs.Synchronize();
+  shard.reclaim_mu.Unlock();
+}
+
+RobotsVerdictCache::RobotsVerdictCache(Rules rules,
+                                       const RobotsVerdictCacheOptions& options)
+    : rules_(std::move(rules)),
+      num_shards_(std::max(1, options.num_shards)),
+      max_shard_entries_(
+          std::max<size_t>(1, options.max_entries / num_shards_)),
+      shards_(new Shard[num_shards_]) {
+  for (int i = 0; i < num_shards_; ++i) {
+    shards_[i].entries.reset(new Entry[max_shard_entries_]);
+  }
+}
+
+RobotsVerdictCache::Shard& RobotsVerdictCache::ShardFor(const Key& key) const {
+  // The high bits, as the hash tables of the shards use the low ones.
+  const size_t hash = absl::Hash<Key>()(key);
+  return shards_[(hash >> 32) % num_shards_];
+}
+
+bool RobotsVerdictCache::IsAllowed(absl::string_view user_agent,
+                                   absl::string_view url) const {
+  // Rules deciding all URLs at once are quicker than the cache.
+  const HostVerdict host_verdict = rules_->GetHostVerdict(user_agent);
+  if (host_verdict != HostVerdict::PER_URL) {
+    return host_verdict == HostVerdict::ALLOW_ALL;
+  }
+  return Evaluate(user_agent, url).allowed;
+}
+
+RobotsVerdict RobotsVerdictCache::Evaluate(absl::string_view user_agent,
+                                           absl::string_view url) const {
+  // Only written, and allocating, when the URL has no path of its own.
+  std::string path_buffer;
+  Key key;
+  if (!rules_->GetDecisivePath(user_agent, url, &path_buffer,
+                               &key.decisive_path)) {
+    uncached_.fetch_add(1, std::memory_order_relaxed);
+    return rules_->Evaluate(user_agent, url);
+  }
+  key.user_agent_id = rules_->GetUserAgentId(user_agent);
+  Shard& shard = ShardFor(key);
+  {
+    absl::ReaderMutexLock lock(&shard.mu);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      const Entry& entry = shard.entries[it->second];
+      // Lookups share the lock, so only write the flag when it changes.
+      if (!entry.referenced.load(std::memory_order_relaxed)) {
+        entry.referenced.store(true, std::memory_order_relaxed);
+      }
+      shard.hits.fetch_add(1, std::memory_order_relaxed);
+      return entry.verdict;
+    }
+  }
+  shard.misses.fetch_add(1, std::memory_order_relaxed);
+  const RobotsVerdict verdict = rules_->Evaluate(user_agent, url);
+  absl::MutexLock lock(&shard.mu);
+  Insert(shard, key, verdict);
+  return verdict;
+}
+
+void RobotsVerdictCache::Insert(Shard& shard, const Key& key,
+                                const RobotsVerdict& verdict) const {
+  // Another thread may have cached the same verdict meanwhile.
+  if (shard.index.contains(key)) return;
+  size_t slot;
+  if (shard.num_entries < max_shard_entries_) {
+    slot = shard.num_entries++;
+  } else {
+    // Give a second chance to the entries used since the hand last passed.
+    while (shard.entries[shard.hand].referenced.exchange(
+        false, std::memory_order_relaxed)) {
+      shard.hand = (shard.hand + 1) % max_shard_entries_;
+    }
+    slot = shard.hand;
+    shard.hand = (shard.hand + 1) % max_shard_entries_;
+    const Entry& evicted = shard.entries[slot];
+    shard.index.erase(Key{evicted.user_agent_id, evicted.decisive_path});
+    shard.evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  Entry& entry = shard.entries[slot];
+  entry.user_agent_id = key.user_agent_id;
+  // Assigned in place, reusing the buffer of the evicted entry.
+  entry.decisive_path.assign(key.decisive_path.data(),
+                             key.decisive_path.size());
+  entry.verdict = verdict;
+  entry.referenced.store(false, std::memory_order_relaxed);
+  shard.index.emplace(Key{entry.user_agent_id, entry.decisive_path}, slot);
+}
+
+RobotsVerdictCacheStats RobotsVerdictCache::stats() const {
+  RobotsVerdictCacheStats stats;
+  stats.bytes = sizeof(*this) + num_shards_ * sizeof(Shard);
+  for (int i = 0; i < num_shards_; ++i) {
+    const Shard& shard = shards_[i];
+    stats.hits += shard.hits.load(std::memory_order_relaxed);
+    stats.misses += shard.misses.load(std::memory_order_relaxed);
+    stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+    absl::ReaderMutexLock lock(&shard.mu);
+    stats.entries += shard.index.size();
+    stats.bytes += max_shard_entries_ * sizeof(Entry) +
+                   shard.index.capacity() *
+                       (sizeof(std::pair<Key, size_t>) + 1);
+    for (size_t j = 0; j < shard.num_entries; ++j) {
+      stats.bytes += shard.entries[j].decisive_path.capacity();
+    }
+  }
+  stats.uncached = uncached_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace googlebot
@@ -0,0 +1,421 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_cache.h
+// -----------------------------------------------------------------------------
+//
+// A cache of compiled robots.txt rules per host, for crawlers checking many
+// URLs of many hosts from many threads (class RobotsCache), and a cache of
+// the verdicts of some compiled rules (class RobotsVerdictCache).
+
+#ifndef THIRD_PARTY_ROBOTSTXT_ROBOTS_CACHE_H_
+#define THIRD_PARTY_ROBOTSTXT_ROBOTS_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "robots.h"
+#include "robots_epoch.h"
+
+namespace googlebot {
+
+struct RobotsCacheOptions {
+  // Maximum number of bytes used by the cached rules and their keys, see
+  // CompiledRobots::MemoryUsage(). Rules shared by several keys count once for
+  // each of them. Rules are evicted once it's exceeded.
+  size_t max_bytes = 64 << 20;
+  // Number of independently locked parts of the cache, each holding the keys
+  // of some hosts and an equal part of 'max_bytes'. More shards let more
+  // threads update the cache at once.
+  int num_shards = 16;
+  // How long cached rules are used for, or absl::InfiniteDuration() to keep
+  // them until evicted.
+  absl::Duration ttl = absl::Hours(24);
+  // Returns the current time. Replaceable for tests.
+  std::function<absl::Time()> clock = absl::Now;
+};
+
+// Counters of a RobotsCache since it was created.
+struct RobotsCacheStats {
+  int64_t hits = 0;          // Lookups finding rules.
+  int64_t misses = 0;        // Lookups finding no rules, or expired ones.
+  int64_t compilations = 0;  // Robots.txt bodies compiled by GetOrCompile().
+  int64_t interned = 0;  // GetOrCompile() misses given the rules of an
+                         // identical body already cached for another key.
+  int64_t evictions = 0;     // Rules dropped to stay within the byte budget.
+  int64_t expirations = 0;   // Rules dropped after their TTL.
+  int64_t entries = 0;       // Rules cached now.
+  int64_t bytes = 0;         // Bytes used by the cached rules now.
+  int64_t unique_rules = 0;  // Distinct rules cached now.
+  // Bytes of the rules cached now, counting shared rules once for each of
+  // their keys, and only once.
+  int64_t rules_bytes = 0;
+  int64_t unique_rules_bytes = 0;
+
+  // Returns the number of keys per distinct rules.
+  double dedup_ratio() const {
+    return unique_rules == 0 ? 1.0 : static_cast<double>(entries) / unique_rules;
+  }
+  // Returns the bytes saved by sharing the rules of identical bodies.
+  int64_t bytes_saved() const { return rules_bytes - unique_rules_bytes; }
+};
+
+// RobotsCache - maps hosts to their compiled robots.txt rules.
+//
+// The keys are chosen by the caller, typically the host or origin the
+// robots.txt was fetched from. Rules are shared with the callers through
+// std::shared_ptr, so evicting them never invalidates rules in use.
+//
+// Many hosts serve byte-identical robots.txt files. GetOrCompile() finds the
+// rules already cached for an identical body by a hash of its content, and
+// shares them instead of compiling the body again.
+//
+// The cache is split into shards by the hash of the key. Lookups take no
+// lock: each shard publishes its entries in an open addressing hash table of
+// atomic pointers, and entries are never modified once published. Writers
+// take the lock of the shard, and store, replace or remove the pointer to the
+// entry of the key, or rebuild the table once half its slots are used. Once
+// the lock is released, what was removed is freed when the lookups that may
+// still read it are done, see ReaderEpochs. Eviction is the CLOCK
+// approximation of least-recently-used, which only needs a hit to set a flag
+// on the entry.
+//
+// All methods are thread-safe.
+class RobotsCache {
+ public:
+  using Rules = std::shared_ptr<const CompiledRobots>;
+
+  explicit RobotsCache(const RobotsCacheOptions& options = {});
+
+  // Disallow copying and assignment.
+  RobotsCache(const RobotsCache&) = delete;
+  RobotsCache& operator=(const RobotsCache&) = delete;
+
+  // Returns the rules cached for 'key', or nullptr if there are none or they
+  // have expired.
+  Rules Get(absl::string_view key) const;
+
+  // Caches 'rules', which must not be null, for 'key', replacing the rules
+  // cached for it. Rules larger than the part of the byte budget of a shard
+  // aren't cached.
+  void Put(absl::string_view key, Rules rules);
+
+  // Returns the rules cached for 'key', or compiles 'robots_body' and caches
+  // the result. When several threads miss the same key at once, only one of
+  // them compiles and the others wait for its result. When the rules of an
+  // identical body are cached for another key, they're shared instead.
+  Rules GetOrCompile(absl::string_view key, absl::string_view robots_body);
+
+  // Removes the rules cached for 'key', if any.
+  void Erase(absl::string_view key);
+
+  RobotsCacheStats stats() const;
+
+ private:
+  struct Entry {
+    Entry(std::string key, size_t hash, Rules rules, size_t bytes,
+          absl::Time expiration)
+        : key(std::move(key)),
+          hash(hash),
+          rules(std::move(rules)),
+          bytes(bytes),
+          expiration(expiration) {}
+
+    const std::string key;
+    const size_t hash;  // Of 'key', see HashKey().
+    const Rules rules;
+    const size_t bytes;
+    const absl::Time expiration;
+    // Set by lookups, cleared as the clock hand passes the entry.
+    mutable std::atomic<bool> referenced{false};
+  };
+
+  // The entries of a shard by the low bits of the hash of their key, with
+  // linear probing, as read by lookups. Slots are null until used, and hold
+  // Removed() once their entry is removed, so that probing goes on past them.
+  class Table {
+   public:
+    // 'num_slots' must be a power of two.
+    explicit Table(size_t num_slots);
+
+    size_t num_slots() const { return mask_ + 1; }
+    // Returns the slot at position 'i' modulo the number of slots.
+    std::atomic<const Entry*>& slot(size_t i) const {
+      return slots_[i & mask_];
+    }
+
+   private:
+    const size_t mask_;
+    const std::unique_ptr<std::atomic<const Entry*>[]> slots_;
+  };
+
+  // The entries in the order the clock hand visits them.
+  using EntryList = std::list<std::unique_ptr<const Entry>>;
+
+  // What writers removed from a shard, to be freed once no lookup reads it.
+  struct Retired {
+    std::vector<std::unique_ptr<const Table>> tables;
+    std::vector<std::unique_ptr<const Entry>> entries;
+  };
+
+  struct Shard {
+    ~Shard() { delete table.load(std::memory_order_relaxed); }
+
+    // The current table, read under a ReadLock of 'epochs'. Its slots are
+    // written, and it is replaced, under 'mu'.
+    std::atomic<const Table*> table{new Table(kMinSlots)};
+    ReaderEpochs epochs;
+
+    // Serializes the writers of the shard.
+    mutable absl::Mutex mu;
+    EntryList entries ABSL_GUARDED_BY(mu);
+    // The position of each entry in 'entries'.
+    absl::flat_hash_map<absl::string_view, EntryList::iterator> index
+        ABSL_GUARDED_BY(mu);
+    EntryList::iterator hand ABSL_GUARDED_BY(mu);
+    size_t bytes ABSL_GUARDED_BY(mu) = 0;
+    // The slots of 'table' that aren't null.
+    size_t used_slots ABSL_GUARDED_BY(mu) = 0;
+    Retired retired ABSL_GUARDED_BY(mu);
+    // Held while freeing what was retired, so that calls to
+    // ReaderEpochs::Synchronize() don't overlap. Acquired before 'mu'.
+    absl::Mutex reclaim_mu;
+    // Compilations under way by GetOrCompile().
+    absl::flat_hash_map<std::string, std::shared_future<Rules>> in_flight
+        ABSL_GUARDED_BY(mu);
+
+    std::atomic<int64_t> compilations{0};
+    std::atomic<int64_t> evictions{0};
+    std::atomic<int64_t> expirations{0};
+  };
+
+  // The lookups of some of the threads. Lookups share no cache line with
+  // the lookups of other threads, unless there are more threads than
+  // counters.
+  struct alignas(64) LookupCounters {
+    std::atomic<int64_t> hits{0};
+    std::atomic<int64_t> misses{0};
+  };
+  static constexpr int kNumLookupCounters = 16;
+  // The number of slots of the table of an empty shard.
+  static constexpr size_t kMinSlots = 16;
+
+  // Two independent 64-bit hashes of a robots.txt body.
+  using ContentHash = std::pair<uint64_t, uint64_t>;
+
+  // Rules referenced by cache entries.
+  struct SharedRules {
+    Rules rules;
+    size_t bytes = 0;  // CompiledRobots::MemoryUsage().
+    int num_entries = 0;
+    // The hash of the body the rules were compiled from, if known.
+    bool has_content_hash = false;
+    ContentHash content_hash;
+  };
+
+  static ContentHash HashContent(absl::string_view robots_body);
+
+  static size_t HashKey(absl::string_view key);
+  Shard& ShardFor(size_t hash) const;
+
+  // Returns the live rules of 'key' in the current table of 'shard', or
+  // nullptr. Takes no lock.
+  Rules Lookup(const Shard& shard, absl::string_view key, size_t hash) const;
+  // Returns the live rules of 'key' in 'table', or nullptr.
+  Rules Find(const Table& table, absl::string_view key, size_t hash) const;
+  // Returns the entry marking the slots of removed entries.
+  static const Entry* Removed();
+  void CountLookup(bool hit) const;
+
+  void Insert(Shard& shard, absl::string_view key, size_t hash, Rules rules,
+              const ContentHash* content_hash)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Removes 'entry' from 'shard', and retires it.
+  void Remove(Shard& shard, EntryList::iterator entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Same, for an entry whose slot already holds another one.
+  void Retire(Shard& shard, EntryList::iterator entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Returns the slot of 'entry' in the table of 'shard'.
+  static std::atomic<const Entry*>& SlotOf(const Shard& shard,
+                                           const Entry* entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Stores 'entry', whose key isn't in the table of 'shard', in a free slot.
+  static void AddToTable(Shard& shard, const Entry* entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Replaces the table of 'shard' with one holding its entries only, sized for
+  // them to use at most a quarter of the slots.
+  static void RebuildTable(Shard& shard)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+  // Frees what was retired from 'shard' once no lookup reads it anymore,
+  // unless another thread is already at it.
+  static void Reclaim(Shard& shard) ABSL_LOCKS_EXCLUDED(shard.mu);
+
+  // Returns the cached rules compiled from a body with 'content_hash', or
+  // nullptr.
+  Rules FindByContent(const ContentHash& content_hash) const
+      ABSL_LOCKS_EXCLUDED(rules_mu_);
+  // Counts a new entry referencing 'rules', compiled from a body with
+  // 'content_hash' if not null. Returns the bytes of 'rules'.
+  size_t AcquireRules(const Rules& rules, const ContentHash* content_hash)
+      ABSL_LOCKS_EXCLUDED(rules_mu_);
+  // Counts an entry referencing 'rules' less.
+  void ReleaseRules(const CompiledRobots* rules) ABSL_LOCKS_EXCLUDED(rules_mu_);
+
+  const RobotsCacheOptions options_;
+  const size_t max_shard_bytes_;
+  std::unique_ptr<Shard[]> shards_;
+  mutable LookupCounters lookup_counters_[kNumLookupCounters];
+
+  // Acquired after the lock of a shard, if both are held.
+  mutable absl::Mutex rules_mu_;
+  absl::flat_hash_map<const CompiledRobots*, SharedRules> shared_rules_
+      ABSL_GUARDED_BY(rules_mu_);
+  absl::flat_hash_map<ContentHash, const CompiledRobots*> rules_by_content_
+      ABSL_GUARDED_BY(rules_mu_);
+  int64_t rules_bytes_ ABSL_GUARDED_BY(rules_mu_) = 0;
+  int64_t unique_rules_bytes_ ABSL_GUARDED_BY(rules_mu_) = 0;
+  std::atomic<int64_t> interned_{0};
+};
+
+struct RobotsVerdictCacheOptions {
+  // Maximum number of verdicts cached. The oldest unused ones are evicted
+  // once it's reached.
+  size_t max_entries = 4096;
+  // Number of independently locked parts of the cache, each holding an equal
+  // part of 'max_entries'.
+  int num_shards = 8;
+};
+
+// Counters of a RobotsVerdictCache since it was created.
+struct RobotsVerdictCacheStats {
+  int64_t hits = 0;      // Checks answered from the cache.
+  int64_t misses = 0;    // Checks evaluated, then cached.
+  int64_t uncached = 0;  // Checks of rules looking at the whole path, which
+                         // are always evaluated.
+  int64_t evictions = 0;  // Verdicts dropped to make room.
+  int64_t entries = 0;    // Verdicts cached now.
+  int64_t bytes = 0;      // Bytes used by the cache now.
+
+  // Returns the share of the checks answered from the cache.
+  double hit_rate() const {
+    const int64_t checks = hits + misses + uncached;
+    return checks == 0 ? 0.0 : static_cast<double>(hits) / checks;
+  }
+};
+
+// RobotsVerdictCache - remembers the verdicts of some compiled rules.
+//
+// Crawlers check many URLs of the same directories, which differ only past
+// the longest pattern of the robots.txt, as in "/product/123?ref=...". All
+// such URLs get the same verdict, so the cache is keyed by the groups applying
+// to the user agent and the part of the path that decides the verdict, see
+// CompiledRobots::GetUserAgentId() and CompiledRobots::GetDecisivePath().
+// User agents getting the same groups, as "FooBot" and "foobot" do, or all
+// those the robots.txt doesn't name, share their verdicts. Checks of rules
+// looking at the whole path, as wildcards in the middle of a pattern do,
+// aren't cached. Hits don't allocate.
+//
+// Lookups take a shared lock on their shard only, and evict with the CLOCK
+// approximation of least-recently-used, as RobotsCache does.
+//
+// All methods are thread-safe.
+class RobotsVerdictCache {
+ public:
+  using Rules = std::shared_ptr<const CompiledRobots>;
+
+  // 'rules' must not be null.
+  explicit RobotsVerdictCache(Rules rules,
+                              const RobotsVerdictCacheOptions& options = {});
+
+  // Disallow copying and assignment.
+  RobotsVerdictCache(const RobotsVerdictCache&) = delete;
+  RobotsVerdictCache& operator=(const RobotsVerdictCache&) = delete;
+
+  const Rules& rules() const { return rules_; }
+
+  // Same as the CompiledRobots methods.
+  bool IsAllowed(absl::string_view user_agent, absl::string_view url) const;
+  RobotsVerdict Evaluate(absl::string_view user_agent,
+                         absl::string_view url) const;
+
+  RobotsVerdictCacheStats stats() const;
+
+ private:
+  // The groups applying to a user agent, and a decisive path.
+  struct Key {
+    int user_agent_id;
+    absl::string_view decisive_path;
+
+    bool operator==(const Key& other) const {
+      return user_agent_id == other.user_agent_id &&
+             decisive_path == other.decisive_path;
+    }
+    template <typename H>
+    friend H AbslHashValue(H state, const Key& key) {
+      return H::combine(std::move(state), key.user_agent_id,
+                        key.decisive_path);
+    }
+  };
+
+  struct Entry {
+    int user_agent_id = 0;
+    std::string decisive_path;
+    RobotsVerdict verdict;
+    // Set by lookups, cleared as the clock hand passes the entry.
+    mutable std::atomic<bool> referenced{false};
+  };
+
+  struct Shard {
+    mutable absl::Mutex mu;
+    // A fixed number of entries, visited in order by the clock hand.
+    std::unique_ptr<Entry[]> entries;
+    size_t num_entries ABSL_GUARDED_BY(mu) = 0;
+    size_t hand ABSL_GUARDED_BY(mu) = 0;
+    // Keys point into the decisive paths of the entries.
+    absl::flat_hash_map<Key, size_t> index ABSL_GUARDED_BY(mu);
+
+    std::atomic<int64_t> hits{0};
+    std::atomic<int64_t> misses{0};
+    std::atomic<int64_t> evictions{0};
+  };
+
+  Shard& ShardFor(const Key& key) const;
+  void Insert(Shard& shard, const Key& key, const RobotsVerdict& verdict) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mu);
+
+  const Rules rules_;
+  const int num_shards_;
+  const size_t max_shard_entries_;
+  std::unique_ptr<Shard[]> shards_;
+  mutable std::atomic<int64_t> uncached_{0};
+};
+
+}  // namespace googlebot
+#endif  // THIRD_PARTY_ROBOTSTXT_ROBOTS_CACHE_H_
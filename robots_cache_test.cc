@@ -0,0 +1,408 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_cache_test.cc
+// -----------------------------------------------------------------------------
+//
+// This file tests the cache of compiled robots.txt rules per host.
+
+#include "robots_cache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "robots.h"
+#include "robots_allocation_counter.h"
+
+namespace {
+
+using ::googlebot::CompiledRobots;
+using ::googlebot::NumAllocations;
+using ::googlebot::RobotsCache;
+using ::googlebot::RobotsCacheOptions;
+using ::googlebot::RobotsCacheStats;
+using ::googlebot::RobotsVerdict;
+using ::googlebot::RobotsVerdictCache;
+using ::googlebot::RobotsVerdictCacheOptions;
+using ::googlebot::RobotsVerdictCacheStats;
+
+constexpr char kRobotsTxt[] =
+    "user-agent: FooBot\n"
+    "disallow: /private\n";
+
+TEST(RobotsCacheTest, GetAndPut) {
+  RobotsCache cache;
+  EXPECT_EQ(nullptr, cache.Get("foo.bar"));
+  const RobotsCache::Rules rules = CompiledRobots::Create(kRobotsTxt);
+  cache.Put("foo.bar", rules);
+  EXPECT_EQ(rules, cache.Get("foo.bar"));
+  EXPECT_EQ(nullptr, cache.Get("bar.foo"));
+
+  RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(1, stats.entries);
+  EXPECT_LT(static_cast<int64_t>(rules->MemoryUsage()), stats.bytes);
+
+  cache.Erase("foo.bar");
+  EXPECT_EQ(nullptr, cache.Get("foo.bar"));
+  stats = cache.stats();
+  EXPECT_EQ(0, stats.entries);
+  EXPECT_EQ(0, stats.bytes);
+}
+
+TEST(RobotsCacheTest, GetOrCompile) {
+  RobotsCache cache;
+  const RobotsCache::Rules rules = cache.GetOrCompile("foo.bar", kRobotsTxt);
+  ASSERT_NE(nullptr, rules);
+  EXPECT_FALSE(rules->IsAllowed("FooBot", "http://foo.bar/private"));
+  EXPECT_EQ(rules, cache.GetOrCompile("foo.bar", kRobotsTxt));
+  EXPECT_EQ(rules, cache.Get("foo.bar"));
+
+  const RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(1, stats.compilations);
+  EXPECT_EQ(2, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+}
+
+// Threads missing the same key at once share a single compilation.
+TEST(RobotsCacheTest, GetOrCompileConcurrently) {
+  std::string robotstxt = "user-agent: *\n";
+  for (int i = 0; i < 5000; ++i) {
+    absl::StrAppend(&robotstxt, "disallow: /", i, "/*.pdf\n");
+  }
+  RobotsCache cache;
+  constexpr int kNumThreads = 8;
+  std::vector<RobotsCache::Rules> results(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&cache, &robotstxt, &results, i]() {
+      results[i] = cache.GetOrCompile("foo.bar", robotstxt);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  ASSERT_NE(nullptr, results[0]);
+  for (const RobotsCache::Rules& rules : results) {
+    EXPECT_EQ(results[0], rules);
+  }
+  const RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(1, stats.compilations);
+  EXPECT_EQ(kNumThreads, stats.hits + stats.misses);
+}
+
+// Keys with identical bodies share the same rules.
+TEST(RobotsCacheTest, IdenticalBodiesShareRules) {
+  RobotsCache cache;
+  const RobotsCache::Rules rules = cache.GetOrCompile("a.com", kRobotsTxt);
+  EXPECT_EQ(rules, cache.GetOrCompile("b.com", kRobotsTxt));
+  EXPECT_EQ(rules, cache.GetOrCompile("c.com", kRobotsTxt));
+  const RobotsCache::Rules other_rules =
+      cache.GetOrCompile("d.com", "user-agent: *\ndisallow: /\n");
+  EXPECT_NE(rules, other_rules);
+
+  RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(2, stats.compilations);
+  EXPECT_EQ(2, stats.interned);
+  EXPECT_EQ(4, stats.entries);
+  EXPECT_EQ(2, stats.unique_rules);
+  EXPECT_DOUBLE_EQ(2.0, stats.dedup_ratio());
+  const int64_t rules_bytes = rules->MemoryUsage();
+  EXPECT_EQ(3 * rules_bytes + static_cast<int64_t>(other_rules->MemoryUsage()),
+            stats.rules_bytes);
+  EXPECT_EQ(2 * rules_bytes, stats.bytes_saved());
+
+  // Rules put for several keys are shared as well.
+  cache.Put("e.com", other_rules);
+  EXPECT_EQ(2, cache.stats().unique_rules);
+
+  // Rules no longer cached for any key aren't shared anymore.
+  for (const char* key : {"a.com", "b.com", "c.com"}) cache.Erase(key);
+  stats = cache.stats();
+  EXPECT_EQ(1, stats.unique_rules);
+  EXPECT_EQ(static_cast<int64_t>(other_rules->MemoryUsage()),
+            stats.bytes_saved());
+  EXPECT_NE(rules, cache.GetOrCompile("f.com", kRobotsTxt));
+  EXPECT_EQ(3, cache.stats().compilations);
+}
+
+TEST(RobotsCacheTest, Ttl) {
+  absl::Time now = absl::UnixEpoch();
+  RobotsCacheOptions options;
+  options.ttl = absl::Hours(1);
+  options.clock = [&now]() { return now; };
+  RobotsCache cache(options);
+
+  const RobotsCache::Rules rules = cache.GetOrCompile("foo.bar", kRobotsTxt);
+  now += absl::Minutes(59);
+  EXPECT_EQ(rules, cache.Get("foo.bar"));
+  now += absl::Minutes(1);
+  EXPECT_EQ(nullptr, cache.Get("foo.bar"));
+
+  const RobotsCache::Rules fresh_rules =
+      cache.GetOrCompile("foo.bar", "user-agent: FooBot\ndisallow: /\n");
+  EXPECT_NE(rules, fresh_rules);
+  EXPECT_EQ(fresh_rules, cache.Get("foo.bar"));
+  EXPECT_EQ(2, cache.stats().compilations);
+  EXPECT_EQ(1, cache.stats().entries);
+
+  // An unchanged body doesn't need to be compiled again.
+  now += absl::Hours(1);
+  EXPECT_EQ(fresh_rules,
+            cache.GetOrCompile("foo.bar", "user-agent: FooBot\ndisallow: /\n"));
+  EXPECT_EQ(2, cache.stats().compilations);
+}
+
+// Expired rules are dropped first when making room.
+TEST(RobotsCacheTest, ExpiredRulesAreDroppedFirst) {
+  absl::Time now = absl::UnixEpoch();
+  RobotsCacheOptions options;
+  options.num_shards = 1;
+  options.ttl = absl::Hours(1);
+  options.clock = [&now]() { return now; };
+  {
+    RobotsCache cache(options);
+    cache.GetOrCompile("aaa", kRobotsTxt);
+    options.max_bytes = 2 * cache.stats().bytes + 1;
+  }
+  RobotsCache cache(options);
+  cache.GetOrCompile("aaa", kRobotsTxt);
+  now += absl::Minutes(30);
+  cache.GetOrCompile("bbb", kRobotsTxt);
+  cache.Get("aaa");
+  now += absl::Minutes(31);
+  cache.GetOrCompile("ccc", kRobotsTxt);
+
+  const RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(1, stats.expirations);
+  EXPECT_EQ(0, stats.evictions);
+  EXPECT_NE(nullptr, cache.Get("bbb"));
+  EXPECT_NE(nullptr, cache.Get("ccc"));
+}
+
+TEST(RobotsCacheTest, EvictsWithinByteBudget) {
+  RobotsCacheOptions options;
+  options.num_shards = 1;
+  int64_t entry_bytes;
+  {
+    RobotsCache cache(options);
+    cache.GetOrCompile("host-0", kRobotsTxt);
+    entry_bytes = cache.stats().bytes;
+  }
+  options.max_bytes = 3 * entry_bytes + entry_bytes / 2;
+  RobotsCache cache(options);
+  for (const char* key : {"host-a", "host-b", "host-c"}) {
+    cache.GetOrCompile(key, kRobotsTxt);
+  }
+  EXPECT_EQ(3, cache.stats().entries);
+
+  // The clock hand gives a second chance to the rules used since it passed.
+  cache.Get("host-a");
+  cache.GetOrCompile("host-d", kRobotsTxt);
+  RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(1, stats.evictions);
+  EXPECT_EQ(3, stats.entries);
+  EXPECT_NE(nullptr, cache.Get("host-a"));
+  EXPECT_EQ(nullptr, cache.Get("host-b"));
+
+  for (int i = 0; i < 100; ++i) {
+    cache.GetOrCompile(absl::StrCat("host-", i), kRobotsTxt);
+  }
+  stats = cache.stats();
+  EXPECT_EQ(3, stats.entries);
+  EXPECT_LE(stats.bytes, static_cast<int64_t>(options.max_bytes));
+
+  // Rules larger than the budget are still returned, but not cached.
+  std::string large_robotstxt = "user-agent: *\n";
+  for (int i = 0; i < 1000; ++i) {
+    absl::StrAppend(&large_robotstxt, "disallow: /", i, "\n");
+  }
+  EXPECT_NE(nullptr, cache.GetOrCompile("large", large_robotstxt));
+  EXPECT_EQ(nullptr, cache.Get("large"));
+  EXPECT_EQ(3, cache.stats().entries);
+}
+
+// Keys stay found as the tables of the shards are rebuilt, and removed ones
+// stay gone.
+TEST(RobotsCacheTest, ManyKeys) {
+  RobotsCacheOptions options;
+  options.num_shards = 2;
+  options.max_bytes = size_t{1} << 40;
+  RobotsCache cache(options);
+  const RobotsCache::Rules rules = CompiledRobots::Create(kRobotsTxt);
+  constexpr int kNumKeys = 5000;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < kNumKeys; ++i) {
+      cache.Put(absl::StrCat("host-", i), rules);
+    }
+    for (int i = 0; i < kNumKeys; i += 2) cache.Erase(absl::StrCat("host-", i));
+    for (int i = 0; i < kNumKeys; ++i) {
+      EXPECT_EQ(i % 2 == 0 ? nullptr : rules,
+                cache.Get(absl::StrCat("host-", i)))
+          << i;
+    }
+    EXPECT_EQ(kNumKeys / 2, cache.stats().entries);
+  }
+}
+
+// Lookups racing with writes, evictions and erasures see either the rules put
+// last or none, and are all counted.
+TEST(RobotsCacheTest, LookupsDuringWrites) {
+  RobotsCacheOptions options;
+  options.num_shards = 2;
+  const RobotsCache::Rules rules[] = {
+      CompiledRobots::Create(kRobotsTxt),
+      CompiledRobots::Create("user-agent: *\ndisallow: /\n")};
+  options.max_bytes = 20 * rules[0]->MemoryUsage();
+  RobotsCache cache(options);
+  constexpr int kNumKeys = 50;
+  std::atomic<bool> done(false);
+  std::atomic<int> unknown_rules(0);
+  std::atomic<int64_t> lookups(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+      for (int i = t; !done; ++i) {
+        const RobotsCache::Rules found =
+            cache.Get(absl::StrCat("host-", i % kNumKeys));
+        if (found != nullptr && found != rules[0] && found != rules[1]) {
+          unknown_rules.fetch_add(1);
+        }
+        lookups.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (int i = 0; i < 2000; ++i) {
+    const std::string key = absl::StrCat("host-", i % kNumKeys);
+    if (i % 7 == 0) {
+      cache.Erase(key);
+    } else {
+      cache.Put(key, rules[i % 2]);
+    }
+  }
+  done = true;
+  for (std::thread& reader : readers) reader.join();
+
+  EXPECT_EQ(0, unknown_rules.load());
+  const RobotsCacheStats stats = cache.stats();
+  EXPECT_EQ(lookups.load(), stats.hits + stats.misses);
+  EXPECT_LT(0, stats.evictions);
+  EXPECT_LE(stats.bytes, static_cast<int64_t>(options.max_bytes));
+}
+
+constexpr char kProductRobotsTxt[] =
+    "user-agent: *\n"
+    "disallow: /product/\n"
+    "allow: /product/public$\n"
+    "\n"
+    "user-agent: BarBot\n"
+    "disallow: /*.pdf\n";
+
+// URLs differing past the longest pattern share a cached verdict.
+TEST(RobotsVerdictCacheTest, SharesVerdictsOfDecisivePath) {
+  const RobotsVerdictCache cache(CompiledRobots::Create(kProductRobotsTxt));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FALSE(cache.IsAllowed(
+        "FooBot", absl::StrCat("http://foo.bar/product/123?ref=", i)));
+  }
+  EXPECT_TRUE(cache.IsAllowed("FooBot", "http://foo.bar/product/public"));
+  EXPECT_FALSE(cache.IsAllowed("FooBot", "http://foo.bar/product/public2"));
+  const RobotsVerdict verdict =
+      cache.Evaluate("FooBot", "http://foo.bar/product/public");
+  EXPECT_TRUE(verdict.allowed);
+  EXPECT_EQ(3, verdict.matching_line);
+
+  const RobotsVerdictCacheStats stats = cache.stats();
+  EXPECT_EQ(3, stats.misses);
+  EXPECT_EQ(10, stats.hits);
+  EXPECT_EQ(0, stats.uncached);
+  EXPECT_EQ(3, stats.entries);
+  EXPECT_LT(0, stats.bytes);
+  EXPECT_DOUBLE_EQ(10.0 / 13, stats.hit_rate());
+}
+
+TEST(RobotsVerdictCacheTest, KeepsUserAgentsApart) {
+  const RobotsVerdictCache cache(CompiledRobots::Create(
+      "user-agent: FooBot\ndisallow: /a\nuser-agent: BarBot\nallow: /\n"));
+  EXPECT_FALSE(cache.Evaluate("FooBot", "http://foo.bar/a").allowed);
+  EXPECT_TRUE(cache.Evaluate("BarBot", "http://foo.bar/a").allowed);
+  EXPECT_EQ(2, cache.stats().misses);
+}
+
+// User agents getting the same groups share their verdicts.
+TEST(RobotsVerdictCacheTest, SharesVerdictsOfUserAgentsWithSameGroups) {
+  const RobotsVerdictCache cache(CompiledRobots::Create(
+      "user-agent: FooBot\ndisallow: /a\nuser-agent: *\nallow: /\n"));
+  EXPECT_FALSE(cache.Evaluate("FooBot", "http://foo.bar/a").allowed);
+  EXPECT_FALSE(cache.Evaluate("foobot", "http://foo.bar/a").allowed);
+  EXPECT_TRUE(cache.Evaluate("BarBot", "http://foo.bar/a").allowed);
+  EXPECT_TRUE(cache.Evaluate("BazBot", "http://foo.bar/a").allowed);
+  // Not a product token of its own, so the global groups apply.
+  EXPECT_TRUE(cache.Evaluate("FooBot/2.1", "http://foo.bar/a").allowed);
+  const RobotsVerdictCacheStats stats = cache.stats();
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(3, stats.hits);
+  EXPECT_EQ(2, stats.entries);
+}
+
+TEST(RobotsVerdictCacheTest, HitsDontAllocate) {
+  const RobotsVerdictCache cache(CompiledRobots::Create(kProductRobotsTxt));
+  const std::string url = absl::StrCat(
+      "http://foo.bar/product/", std::string(100, '1'), "?ref=search");
+  EXPECT_FALSE(cache.IsAllowed("FooBot", url));
+  const int64_t allocations = NumAllocations();
+  EXPECT_FALSE(cache.IsAllowed("FooBot", url));
+  EXPECT_FALSE(cache.Evaluate("FooBot", url).allowed);
+  EXPECT_EQ(allocations, NumAllocations());
+  EXPECT_EQ(2, cache.stats().hits);
+}
+
+// Rules looking at the whole path are always evaluated.
+TEST(RobotsVerdictCacheTest, DoesntCacheWildcards) {
+  const RobotsVerdictCache cache(CompiledRobots::Create(kProductRobotsTxt));
+  EXPECT_FALSE(cache.IsAllowed("BarBot", "http://foo.bar/a.pdf"));
+  EXPECT_TRUE(cache.IsAllowed("BarBot", "http://foo.bar/a.html"));
+  const RobotsVerdictCacheStats stats = cache.stats();
+  EXPECT_EQ(2, stats.uncached);
+  EXPECT_EQ(0, stats.entries);
+}
+
+TEST(RobotsVerdictCacheTest, EvictsWithinMaxEntries) {
+  RobotsVerdictCacheOptions options;
+  options.max_entries = 4;
+  options.num_shards = 1;
+  const RobotsVerdictCache cache(
+      CompiledRobots::Create("user-agent: *\ndisallow: /product/12\n"),
+      options);
+  for (int i = 0; i < 200; ++i) {
+    const std::string id = absl::StrCat(i);
+    EXPECT_EQ(!absl::StartsWith(id, "12"),
+              cache.IsAllowed("FooBot",
+                              absl::StrCat("http://foo.bar/product/", id)))
+        << id;
+  }
+  const RobotsVerdictCacheStats stats = cache.stats();
+  EXPECT_EQ(4, stats.entries);
+  EXPECT_EQ(stats.misses - 4, stats.evictions);
+}
+
+}  // namespace
@@ -0,0 +1,73 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_epoch.cc
+// -----------------------------------------------------------------------------
+//
+// Implements epoch-based reclamation.
+
+#include "robots_epoch.h"
+
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace googlebot {
+
+int ThreadNumber() {
+  static std::atomic<int> next_number{0};
+  thread_local const int number =
+      next_number.fetch_add(1, std::memory_order_relaxed);
+  return number;
+}
+
+void ReaderEpochs::Synchronize() {
+  // Readers entering from now on announce themselves in the counters of the
+  // other parity, and see the data stored before. Only the readers of the
+  // previous epoch may still use the replaced data. The readers of the epoch
+  // before it were waited for by the previous call.
+  const int parity = epoch_.fetch_add(1) & 1;
+  for (const ReaderCounters& shard : reader_shards_) {
+    // Readers are done quickly unless preempted, then sleep rather than spin.
+    for (int spins = 0; shard.readers[parity].load() != 0; ++spins) {
+      if (spins < 100) {
+        std::this_thread::yield();
+      } else {
+        absl::SleepFor(absl::Microseconds(50));
+      }
+    }
+  }
+}
+
+ReaderEpochs::ReadLock::ReadLock(const ReaderEpochs& epochs) {
+  ReaderCounters& shard =
+      epochs.reader_shards_[ThreadNumber() % kNumReaderShards];
+  while (true) {
+    const uint64_t epoch = epochs.epoch_.load();
+    readers_ = &shard.readers[epoch & 1];
+    readers_->fetch_add(1);
+    // If the epoch moved on meanwhile, Synchronize() may have checked the
+    // counter before it was incremented, and may free the data read next.
+    if (epochs.epoch_.load() == epoch) break;
+    readers_->fetch_sub(1);
+  }
+}
+
+ReaderEpochs::ReadLock::~ReadLock() {
+  readers_->fetch_sub(1, std::memory_order_release);
+}
+
+}  // namespace googlebot
@@ -0,0 +1,92 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_epoch.h
+// -----------------------------------------------------------------------------
+//
+// Epoch-based reclamation, for data read without locks and replaced while in
+// use (class ReaderEpochs).
+
+#ifndef THIRD_PARTY_ROBOTSTXT_ROBOTS_EPOCH_H_
+#define THIRD_PARTY_ROBOTSTXT_ROBOTS_EPOCH_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace googlebot {
+
+// Returns a number for the calling thread, the same on each call, which
+// spreads the counters of the threads over cache lines.
+int ThreadNumber();
+
+// ReaderEpochs - tells a writer when the readers that may still see the data
+// it replaced are done with it.
+//
+// Readers announce themselves with a ReadLock in the counter of the current
+// epoch, picked by its parity, then load the data through an atomic pointer.
+// A writer swaps the pointer to the new data in, then calls Synchronize(),
+// which moves on to the next epoch before waiting for the counter of the
+// previous one to drop to zero. Readers entering from then on see the new
+// data, so the replaced data can be freed once Synchronize() returns. The
+// counters are spread over cache lines by thread, so that readers don't
+// contend.
+//
+// ReadLocks never block, and only wait for a concurrent Synchronize() to move
+// to the next epoch, which doesn't wait for anything. Synchronize() waits for
+// the readers of the previous epoch, so ReadLocks must be short-lived.
+//
+// ReadLocks are thread-safe, while calls to Synchronize() must not overlap.
+class ReaderEpochs {
+ public:
+  ReaderEpochs() = default;
+
+  // Disallow copying and assignment.
+  ReaderEpochs(const ReaderEpochs&) = delete;
+  ReaderEpochs& operator=(const ReaderEpochs&) = delete;
+
+  // Returns the number of calls to Synchronize() so far.
+  uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+  // Moves to the next epoch, and returns once the readers of the previous one
+  // are done.
+  void Synchronize();
+
+  // Keeps the data loaded while it exists alive.
+  class ReadLock {
+   public:
+    explicit ReadLock(const ReaderEpochs& epochs);
+    ~ReadLock();
+
+    // Disallow copying and assignment.
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+   private:
+    std::atomic<int64_t>* readers_;
+  };
+
+ private:
+  // The readers of each epoch parity, for some of the threads.
+  struct alignas(64) ReaderCounters {
+    std::atomic<int64_t> readers[2] = {{0}, {0}};
+  };
+  static constexpr int kNumReaderShards = 16;
+
+  std::atomic<uint64_t> epoch_{0};
+  mutable ReaderCounters reader_shards_[kNumReaderShards];
+};
+
+}  // namespace googlebot
+#endif  // THIRD_PARTY_ROBOTSTXT_ROBOTS_EPOCH_H_
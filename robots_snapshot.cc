@@ -0,0 +1,352 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_snapshot.cc
+// -----------------------------------------------------------------------------
+//
+// Implements the snapshot of the compiled robots.txt rules of many hosts.
+
+#include "robots_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace googlebot {
+
+namespace {
+
+// The snapshot header, of 64-bit integers at the offsets below after the
+// magic and the version.
+//
+// Slot record: the hash of the host, the offset of the lowercased host, the
+// offset of its rules, then the 32-bit length of the host and of its rules.
+// Empty slots are all zeros: rules are never empty.
+enum SnapshotHeader : size_t {
+  kMagicOffset = 0,
+  kVersionOffset = 4,
+  kTotalSizeOffset = 8,
+  kNumHostsOffset = 16,
+  kNumSlotsOffset = 24,  // A power of two.
+  kSlotsOffset = 32,
+  kSnapshotHeaderSize = 40,
+};
+
+constexpr char kSnapshotMagic[4] = {'R', 'B', 'T', 'S'};
+constexpr size_t kSlotSize = 32;
+
+// FNV-1a hash of the lowercased 'host'. Snapshots are read by other
+// processes, so the hash must not depend on the process.
+uint64_t HashHost(absl::string_view host) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char c : host) {
+    hash ^= static_cast<unsigned char>(absl::ascii_tolower(c));
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+void WriteUint(size_t offset, uint64_t value, int size, std::string* out) {
+  for (int i = 0; i < size; ++i) {
+    (*out)[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+}  // namespace
+
+void RobotsSnapshotBuilder::Add(absl::string_view host,
+                                absl::string_view robots_body) {
+  Add(host, CompiledRobots(robots_body));
+}
+
+void RobotsSnapshotBuilder::Add(absl::string_view host,
+                                const CompiledRobots& robots) {
+  std::string block = robots.Serialize();
+  auto it = block_index_.find(block);
+  if (it == block_index_.end()) {
+    blocks_.push_back(std::move(block));
+    it = block_index_.emplace(blocks_.back(), blocks_.size() - 1).first;
+  }
+  block_by_host_[absl::AsciiStrToLower(host)] = it->second;
+}
+
+std::string RobotsSnapshotBuilder::Build() const {
+  // The hosts in order, so that the snapshot doesn't depend on the order of
+  // the hash map.
+  std::vector<std::pair<absl::string_view, int>> hosts(block_by_host_.begin(),
+                                                       block_by_host_.end());
+  std::sort(hosts.begin(), hosts.end());
+
+  std::string data(kSnapshotHeaderSize, '\0');
+  // Only the blocks of the hosts still using them, in the order of the hosts.
+  std::vector<uint64_t> block_offsets(blocks_.size(), 0);
+  for (const auto& host : hosts) {
+    uint64_t& offset = block_offsets[host.second];
+    if (offset != 0) continue;
+    offset = data.size();
+    data.append(blocks_[host.second]);
+  }
+  std::vector<uint64_t> host_offsets;
+  host_offsets.reserve(hosts.size());
+  for (const auto& host : hosts) {
+    host_offsets.push_back(data.size());
+    data.append(host.first.data(), host.first.size());
+  }
+
+  // Keep at least half of the slots empty, so that probes stay short.
+  uint64_t num_slots = 1;
+  while (num_slots < 2 * hosts.size()) num_slots *= 2;
+  data.resize((data.size() + 7) / 8 * 8, '\0');
+  const size_t slots_offset = data.size();
+  data.resize(slots_offset + num_slots * kSlotSize, '\0');
+  std::vector<bool> used_slots(num_slots, false);
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    const uint64_t hash = HashHost(hosts[i].first);
+    uint64_t slot = hash & (num_slots - 1);
+    while (used_slots[slot]) slot = (slot + 1) & (num_slots - 1);
+    used_slots[slot] = true;
+    const size_t record = slots_offset + slot * kSlotSize;
+    WriteUint(record, hash, 8, &data);
+    WriteUint(record + 8, host_offsets[i], 8, &data);
+    WriteUint(record + 16, block_offsets[hosts[i].second], 8, &data);
+    WriteUint(record + 24, hosts[i].first.size(), 4, &data);
+    WriteUint(record + 28, blocks_[hosts[i].second].size(), 4, &data);
+  }
+
+  data.replace(kMagicOffset, sizeof(kSnapshotMagic), kSnapshotMagic,
+               sizeof(kSnapshotMagic));
+  WriteUint(kVersionOffset, RobotsSnapshot::kFormatVersion, 4, &data);
+  WriteUint(kTotalSizeOffset, data.size(), 8, &data);
+  WriteUint(kNumHostsOffset, hosts.size(), 8, &data);
+  WriteUint(kNumSlotsOffset, num_slots, 8, &data);
+  WriteUint(kSlotsOffset, slots_offset, 8, &data);
+  return data;
+}
+
+RobotsSnapshot::RobotsSnapshot(absl::string_view data) : data_(data) {
+  if (!Init()) data_ = absl::string_view();
+}
+
+RobotsSnapshot::~RobotsSnapshot() {
+#ifndef _WIN32
+  if (mapping_ != nullptr) munmap(mapping_, mapping_size_);
+#endif
+}
+
+/*static*/ std::unique_ptr<RobotsSnapshot> RobotsSnapshot::Open(
+    const std::string& path, bool verify) {
+  std::unique_ptr<RobotsSnapshot> snapshot(new RobotsSnapshot());
+#ifndef _WIN32
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  const size_t size = file_stat.st_size;
+  void* const mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid once the file is closed.
+  close(fd);
+  if (mapping == MAP_FAILED) return nullptr;
+  snapshot->mapping_ = mapping;
+  snapshot->mapping_size_ = size;
+  snapshot->data_ = absl::string_view(static_cast<const char*>(mapping), size);
+#else
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) return nullptr;
+  snapshot->contents_.assign(std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>());
+  if (!file) return nullptr;
+  snapshot->data_ = snapshot->contents_;
+#endif
+  if (!snapshot->Init() || (verify && !snapshot->Verify())) return nullptr;
+  return snapshot;
+}
+
+/*static*/ std::unique_ptr<RobotsSnapshot> RobotsSnapshot::Create(
+    std::string data) {
+  std::unique_ptr<RobotsSnapshot> snapshot(new RobotsSnapshot());
+  snapshot->contents_ = std::move(data);
+  snapshot->data_ = snapshot->contents_;
+  if (!snapshot->Init()) return nullptr;
+  return snapshot;
+}
+
+uint32_t RobotsSnapshot::Read32(size_t offset) const {
+  uint32_t value = 0;
+  for (int i = 3; i >= 0; --i) {
+    value = value << 8 | static_cast<unsigned char>(data_[offset + i]);
+  }
+  return value;
+}
+
+uint64_t RobotsSnapshot::Read64(size_t offset) const {
+  return uint64_t{Read32(offset + 4)} << 32 | Read32(offset);
+}
+
+bool RobotsSnapshot::ValidateHeader() const {
+  if (data_.size() < kSnapshotHeaderSize ||
+      memcmp(data_.data() + kMagicOffset, kSnapshotMagic,
+             sizeof(kSnapshotMagic)) != 0 ||
+      Read32(kVersionOffset) != kFormatVersion ||
+      Read64(kTotalSizeOffset) != data_.size()) {
+    return false;
+  }
+  const uint64_t num_slots = Read64(kNumSlotsOffset);
+  const uint64_t slots_offset = Read64(kSlotsOffset);
+  // The slots are checked against the size of the data one at a time, so that
+  // no multiplication overflows.
+  return num_slots > 0 && (num_slots & (num_slots - 1)) == 0 &&
+         num_slots <= data_.size() / kSlotSize &&
+         slots_offset >= kSnapshotHeaderSize && slots_offset <= data_.size() &&
+         num_slots * kSlotSize <= data_.size() - slots_offset &&
+         Read64(kNumHostsOffset) <= num_slots;
+}
+
+bool RobotsSnapshot::Init() {
+  if (!ValidateHeader()) return false;
+  block_states_.reset(new std::atomic<uint8_t>[Read64(kNumSlotsOffset)]());
+  return true;
+}
+
+size_t RobotsSnapshot::num_hosts() const {
+  return valid() ? Read64(kNumHostsOffset) : 0;
+}
+
+CompiledRobotsView RobotsSnapshot::Find(absl::string_view host,
+                                        SnapshotLookup* lookup) const {
+  SnapshotLookup unused_lookup;
+  if (lookup == nullptr) lookup = &unused_lookup;
+  *lookup = SnapshotLookup::CORRUPT;
+  if (!valid()) return CompiledRobotsView();
+  const uint64_t hash = HashHost(host);
+  const uint64_t num_slots = Read64(kNumSlotsOffset);
+  const size_t slots_offset = Read64(kSlotsOffset);
+  uint64_t slot = hash & (num_slots - 1);
+  // Snapshots keep slots empty, so that probes of missing hosts end.
+  for (uint64_t probes = 0; probes < num_slots; ++probes) {
+    const size_t record = slots_offset + slot * kSlotSize;
+    if (Read32(record + 28) == 0) {
+      *lookup = SnapshotLookup::NOT_FOUND;
+      return CompiledRobotsView();
+    }
+    if (Read64(record) == hash) {
+      const uint64_t host_offset = Read64(record + 8);
+      const uint32_t host_size = Read32(record + 24);
+      if (host_offset > data_.size() ||
+          host_size > data_.size() - host_offset) {
+        return CompiledRobotsView();
+      }
+      if (absl::EqualsIgnoreCase(data_.substr(host_offset, host_size), host)) {
+        CompiledRobotsView rules = ReadBlock(slot, record);
+        if (rules.valid()) *lookup = SnapshotLookup::FOUND;
+        return rules;
+      }
+    }
+    slot = (slot + 1) & (num_slots - 1);
+  }
+  return CompiledRobotsView();
+}
+
+CompiledRobotsView RobotsSnapshot::ReadBlock(uint64_t slot,
+                                             size_t record) const {
+  std::atomic<uint8_t>& state = block_states_[slot];
+  switch (state.load(std::memory_order_acquire)) {
+    case kWellFormed:
+      return CompiledRobotsView::Unchecked(
+          data_.substr(Read64(record + 16), Read32(record + 28)));
+    case kMalformed:
+      return CompiledRobotsView();
+  }
+  // Threads looking the host up for the first time at once may all check it,
+  // and agree.
+  const uint64_t block_offset = Read64(record + 16);
+  const uint32_t block_size = Read32(record + 28);
+  CompiledRobotsView rules;
+  if (block_offset <= data_.size() &&
+      block_size <= data_.size() - block_offset) {
+    rules = CompiledRobotsView(data_.substr(block_offset, block_size));
+  }
+  state.store(rules.valid() ? kWellFormed : kMalformed,
+              std::memory_order_release);
+  return rules;
+}
+
+bool RobotsSnapshot::Verify() const {
+  if (!valid()) return false;
+  const uint64_t num_slots = Read64(kNumSlotsOffset);
+  const size_t slots_offset = Read64(kSlotsOffset);
+  uint64_t num_hosts = 0;
+  for (uint64_t slot = 0; slot < num_slots; ++slot) {
+    const size_t record = slots_offset + slot * kSlotSize;
+    if (Read32(record + 28) == 0) continue;
+    ++num_hosts;
+    const uint64_t host_offset = Read64(record + 8);
+    const uint32_t host_size = Read32(record + 24);
+    if (host_offset > data_.size() || host_size > data_.size() - host_offset ||
+        HashHost(data_.substr(host_offset, host_size)) != Read64(record) ||
+        !ReadBlock(slot, record).valid()) {
+      return false;
+    }
+  }
+  return num_hosts == Read64(kNumHostsOffset);
+}
+
+LiveRobotsSnapshot::LiveRobotsSnapshot(
+    std::unique_ptr<const RobotsSnapshot> snapshot)
+    : current_(snapshot.release()) {}
+
+LiveRobotsSnapshot::~LiveRobotsSnapshot() {
+  delete current_.load(std::memory_order_acquire);
+}
+
+void LiveRobotsSnapshot::Publish(
+    std::unique_ptr<const RobotsSnapshot> snapshot) {
+  absl::MutexLock lock(&publish_mu_);
+  const RobotsSnapshot* const previous = current_.exchange(snapshot.release());
+  epochs_.Synchronize();
+  delete previous;
+}
+
+LiveRobotsSnapshot::ReadLock::ReadLock(const LiveRobotsSnapshot& live)
+    : lock_(live.epochs_), snapshot_(live.current_.load()) {}
+
+bool LiveRobotsSnapshot::IsAllowed(absl::string_view host,
+                                   absl::string_view user_agent,
+                                   absl::string_view url) const {
+  const ReadLock lock(*this);
+  if (lock.get() == nullptr) return true;
+  SnapshotLookup lookup;
+  const CompiledRobotsView rules = lock.get()->Find(host, &lookup);
+  if (lookup == SnapshotLookup::CORRUPT) return false;
+  return rules.IsAllowed(user_agent, url);
+}
+
+}  // namespace googlebot
@@ -0,0 +1,245 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_snapshot.h
+// -----------------------------------------------------------------------------
+//
+// A single file holding the compiled robots.txt rules of many hosts, looked up
+// in place (class RobotsSnapshot), its builder (class RobotsSnapshotBuilder),
+// and the current snapshot of a crawler, replaced while in use (class
+// LiveRobotsSnapshot).
+
+#ifndef THIRD_PARTY_ROBOTSTXT_ROBOTS_SNAPSHOT_H_
+#define THIRD_PARTY_ROBOTSTXT_ROBOTS_SNAPSHOT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "robots.h"
+#include "robots_epoch.h"
+
+namespace googlebot {
+
+// RobotsSnapshotBuilder - collects the robots.txt rules of many hosts and
+// writes them as a snapshot, see RobotsSnapshot.
+//
+// Hosts with byte-identical compiled rules share a single copy of them in the
+// snapshot.
+class RobotsSnapshotBuilder {
+ public:
+  RobotsSnapshotBuilder() = default;
+
+  // Disallow copying and assignment.
+  RobotsSnapshotBuilder(const RobotsSnapshotBuilder&) = delete;
+  RobotsSnapshotBuilder& operator=(const RobotsSnapshotBuilder&) = delete;
+
+  // Adds the rules of 'robots_body' for 'host', replacing the rules added for
+  // it before. Hosts are compared ignoring case.
+  void Add(absl::string_view host, absl::string_view robots_body);
+  void Add(absl::string_view host, const CompiledRobots& robots);
+
+  // Returns the number of hosts added so far.
+  size_t num_hosts() const { return block_by_host_.size(); }
+  // Returns the number of distinct rules added so far.
+  size_t num_blocks() const { return blocks_.size(); }
+
+  // Returns the snapshot of the hosts added so far. The result only depends
+  // on the hosts and their rules, not on the order they were added in.
+  std::string Build() const;
+
+ private:
+  // The serialized rules, each once. A deque, so that the keys of
+  // 'block_index_' stay valid as blocks are added.
+  std::deque<std::string> blocks_;
+  absl::flat_hash_map<absl::string_view, int> block_index_;
+  // The block of each host, lowercased.
+  absl::flat_hash_map<std::string, int> block_by_host_;
+};
+
+// The outcome of looking a host up in a RobotsSnapshot.
+enum class SnapshotLookup {
+  // The snapshot has well-formed rules for the host.
+  FOUND = 0,
+  // The snapshot has no rules for the host, which may fetch everything.
+  NOT_FOUND = 1,
+  // The snapshot or the rules of the host aren't well-formed. The rules of the
+  // host are unknown, so callers should disallow its URLs rather than allow
+  // them.
+  CORRUPT = 2,
+};
+
+// RobotsSnapshot - the compiled robots.txt rules of many hosts, read in place.
+//
+// A snapshot starts with a header, followed by the rules of the hosts in the
+// format of CompiledRobots::Serialize(), the hosts, and a hash table from the
+// hosts to their rules. All offsets are relative to the start of the snapshot
+// and all integers are little-endian, so that the file can be mapped at any
+// address. The hash of the hosts is fixed by the format, unlike absl::Hash.
+//
+// Finding a host reads one or a few adjacent slots of the hash table, the name
+// of the host and its rules, so that lookups touch a constant number of pages
+// however many hosts the snapshot holds. Opening a snapshot only checks its
+// header, and each lookup checks the parts it reads, so that hosts never
+// looked up are never read. The rules of a host are checked in full by its
+// first lookup only, which the snapshot remembers in a byte per slot of the
+// hash table: later lookups only read what the check of a URL needs. Verify()
+// checks all of them at once instead.
+//
+// Snapshot files opened by several processes are mapped read-only and shared
+// through the page cache. Files must be replaced by renaming a new file over
+// them, not rewritten in place, as open snapshots keep reading the old file.
+//
+// Snapshots are thread-safe.
+class RobotsSnapshot {
+ public:
+  // The version of the format written by RobotsSnapshotBuilder. Snapshots in
+  // other versions are invalid.
+  static constexpr uint32_t kFormatVersion = 1;
+
+  // A snapshot of 'data', which must outlive it. The snapshot is invalid if
+  // 'data' doesn't start with a well-formed header.
+  explicit RobotsSnapshot(absl::string_view data);
+  ~RobotsSnapshot();
+
+  // Disallow copying and assignment.
+  RobotsSnapshot(const RobotsSnapshot&) = delete;
+  RobotsSnapshot& operator=(const RobotsSnapshot&) = delete;
+
+  // Maps the snapshot file at 'path' read-only. Returns nullptr if the file
+  // can't be read or its header isn't well-formed, or if 'verify' and any of
+  // it isn't, see Verify().
+  static std::unique_ptr<RobotsSnapshot> Open(const std::string& path,
+                                              bool verify = false);
+  // Returns a snapshot owning 'data', as by RobotsSnapshotBuilder::Build(), or
+  // nullptr if its header isn't well-formed.
+  static std::unique_ptr<RobotsSnapshot> Create(std::string data);
+
+  bool valid() const { return !data_.empty(); }
+  size_t num_hosts() const;
+  absl::string_view data() const { return data_; }
+
+  // Returns the rules of 'host', ignoring case, or an invalid view if the
+  // snapshot has none for it or they aren't well-formed. Sets 'lookup', if not
+  // null, to tell these cases apart. The view is valid as long as the
+  // snapshot.
+  CompiledRobotsView Find(absl::string_view host,
+                          SnapshotLookup* lookup = nullptr) const;
+
+  // Checks the hosts and rules of the whole snapshot, as Find() would when
+  // looking up each host. Returns false if any isn't well-formed.
+  bool Verify() const;
+
+ private:
+  // Whether the rules of a slot were checked.
+  enum BlockState : uint8_t { kUnchecked = 0, kWellFormed = 1, kMalformed = 2 };
+
+  RobotsSnapshot() = default;
+
+  // Checks the header and sets up the state of the slots. Returns false if
+  // the header isn't well-formed.
+  bool Init();
+  // Returns the rules of the slot 'slot' at 'record', checking them in full
+  // on the first call only.
+  CompiledRobotsView ReadBlock(uint64_t slot, size_t record) const;
+
+  // Returns the little-endian integers at 'offset' of the data.
+  uint32_t Read32(size_t offset) const;
+  uint64_t Read64(size_t offset) const;
+  bool ValidateHeader() const;
+
+  absl::string_view data_;
+  // The memory mapping of the file, if opened by Open(). The data owned by
+  // the snapshot instead, if created by Create() or opened without mmap().
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  std::string contents_;
+  // The BlockState of each slot of the hash table.
+  std::unique_ptr<std::atomic<uint8_t>[]> block_states_;
+};
+
+// LiveRobotsSnapshot - the current snapshot of a crawler, which a new one can
+// replace while other threads check URLs against it.
+//
+// Publish() swaps the new snapshot in atomically: a check sees either the old
+// snapshot or the new one, never a mix. The old snapshot is freed once the
+// checks that may still use it are done, by epoch-based reclamation, see
+// ReaderEpochs.
+//
+// Checks never block. Publish() waits for the checks that may use the old
+// snapshot, so ReadLocks must be short-lived.
+//
+// All methods are thread-safe.
+class LiveRobotsSnapshot {
+ public:
+  // 'snapshot' may be null, in which case everything is allowed until a
+  // snapshot is published.
+  explicit LiveRobotsSnapshot(
+      std::unique_ptr<const RobotsSnapshot> snapshot = nullptr);
+  // There must be no ReadLock left.
+  ~LiveRobotsSnapshot();
+
+  // Disallow copying and assignment.
+  LiveRobotsSnapshot(const LiveRobotsSnapshot&) = delete;
+  LiveRobotsSnapshot& operator=(const LiveRobotsSnapshot&) = delete;
+
+  // Replaces the current snapshot with 'snapshot', which may be null. Returns
+  // once the previous snapshot is freed. Concurrent calls are serialized.
+  void Publish(std::unique_ptr<const RobotsSnapshot> snapshot);
+
+  // Returns the number of snapshots published so far.
+  uint64_t epoch() const { return epochs_.epoch(); }
+
+  // Keeps the snapshot current when it was created alive, for as long as it
+  // exists.
+  class ReadLock {
+   public:
+    explicit ReadLock(const LiveRobotsSnapshot& live);
+
+    // Disallow copying and assignment.
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+    // Returns the snapshot, or nullptr if there's none.
+    const RobotsSnapshot* get() const { return snapshot_; }
+
+   private:
+    const ReaderEpochs::ReadLock lock_;
+    const RobotsSnapshot* const snapshot_;
+  };
+
+  // Returns true iff 'url' is allowed to be fetched by 'user_agent' according
+  // to the rules of 'host' in the current snapshot. Hosts without rules allow
+  // everything, and hosts whose rules are corrupt, see SnapshotLookup, allow
+  // nothing.
+  bool IsAllowed(absl::string_view host, absl::string_view user_agent,
+                 absl::string_view url) const;
+
+ private:
+  std::atomic<const RobotsSnapshot*> current_;
+  ReaderEpochs epochs_;
+  // Serializes Publish().
+  absl::Mutex publish_mu_;
+};
+
+}  // namespace googlebot
+#endif  // THIRD_PARTY_ROBOTSTXT_ROBOTS_SNAPSHOT_H_
@@ -0,0 +1,205 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_snapshot_main.cc
+// -----------------------------------------------------------------------------
+//
+// Binary writing the snapshot of the robots.txt files of many hosts, to be
+// mapped by crawlers with googlebot::RobotsSnapshot::Open().
+// Usage:
+//     robots_snapshot <snapshot_path> <robots_directory_or_tsv>
+// Arguments:
+// snapshot_path: the file to write. An existing file is replaced by renaming
+//   the new one over it, so that processes mapping it are unaffected.
+// robots_directory_or_tsv: either a directory of robots.txt files, each named
+//   after its host, or a file of tab-separated lines of a host and the path of
+//   its robots.txt file. Empty lines and lines starting with '#' are skipped.
+//   For example: "example.com\t/data/robots/example.com.txt"
+// Return code:
+//   0 when the snapshot was written.
+//   1 when a file couldn't be read or written.
+//   2 when --help is requested or if there is something invalid in the flags
+//   passed.
+//
+#include <cstdio>
+#include <filesystem>  // NOLINT(build/c++17)
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "robots_snapshot.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool LoadFile(const std::string& filename, std::string* result) {
+  std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return false;
+  // tellg() fails with -1, which would resize the result to SIZE_MAX.
+  const std::streamoff size = file.tellg();
+  if (size < 0) return false;
+  result->resize(static_cast<size_t>(size));
+  file.seekg(0, std::ios::beg);
+  file.read(&(*result)[0], size);
+  return static_cast<bool>(file);
+}
+
+bool AddDirectory(const std::string& directory,
+                  googlebot::RobotsSnapshotBuilder* builder) {
+  std::error_code error;
+  // Incremented explicitly, as the increment of a range-based for loop throws
+  // on errors.
+  for (std::filesystem::directory_iterator it(directory, error), end;
+       !error && it != end; it.increment(error)) {
+    if (!it->is_regular_file(error)) {
+      if (error) break;
+      continue;
+    }
+    std::string robots_body;
+    if (!LoadFile(it->path().string(), &robots_body)) {
+      std::cerr << "failed to read file " << it->path() << std::endl;
+      return false;
+    }
+    builder->Add(it->path().filename().string(), robots_body);
+  }
+  if (error) {
+    std::cerr << "failed to list directory \"" << directory
+              << "\": " << error.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool AddTsv(const std::string& filename,
+            googlebot::RobotsSnapshotBuilder* builder) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "failed to read file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int line_num = 1; std::getline(file, line); ++line_num) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') continue;
+    const std::pair<absl::string_view, absl::string_view> fields =
+        absl::StrSplit(line, absl::MaxSplits('\t', 1));
+    if (fields.first.empty() || fields.second.empty()) {
+      std::cerr << filename << ":" << line_num
+                << ": expected a host and a path separated by a tab"
+                << std::endl;
+      return false;
+    }
+    std::string robots_body;
+    if (!LoadFile(std::string(fields.second), &robots_body)) {
+      std::cerr << "failed to read file \"" << fields.second << "\""
+                << std::endl;
+      return false;
+    }
+    builder->Add(fields.first, robots_body);
+  }
+  return true;
+}
+
+// Writes 'contents' to the file 'filename' and flushes it to the disk, so that
+// renaming the file afterwards never replaces a snapshot with a partial one.
+bool WriteFile(const std::string& filename, absl::string_view contents) {
+  std::ofstream file(filename, std::ios::out | std::ios::binary);
+  file.write(contents.data(), contents.size());
+  // Closing flushes the buffer, which may fail as well, for instance if the
+  // disk is full.
+  file.close();
+  if (file.fail()) return false;
+#ifndef _WIN32
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  const bool synced = fsync(fd) == 0;
+  close(fd);
+  return synced;
+#else
+  return true;
+#endif
+}
+
+void ShowHelp(int argc, char** argv) {
+  std::cerr << "Writes the snapshot of the robots.txt files of many hosts."
+            << std::endl
+            << std::endl;
+  std::cerr << "Usage: " << std::endl
+            << "  " << argv[0]
+            << " <snapshot filename> <robots.txt directory or TSV filename>"
+            << std::endl
+            << std::endl;
+  std::cerr << "The files of a directory are named after their host. The "
+            << "lines of a TSV file" << std::endl
+            << "are a host and the filename of its robots.txt." << std::endl
+            << std::endl;
+  std::cerr << "Example: " << std::endl
+            << "  " << argv[0] << " robots.snapshot robots/" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::string output = argc >= 2 ? argv[1] : "";
+  if (output == "-h" || output == "-help" || output == "--help") {
+    ShowHelp(argc, argv);
+    return 2;
+  }
+  if (argc != 3) {
+    std::cerr << "Invalid amount of arguments. Showing help." << std::endl
+              << std::endl;
+    ShowHelp(argc, argv);
+    return 2;
+  }
+
+  googlebot::RobotsSnapshotBuilder builder;
+  const std::string input = argv[2];
+  const bool added = std::filesystem::is_directory(input)
+                         ? AddDirectory(input, &builder)
+                         : AddTsv(input, &builder);
+  if (!added) return 1;
+
+  const std::string snapshot = builder.Build();
+  // Checked once here, so that crawlers may skip the check, see
+  // googlebot::RobotsSnapshot::Open().
+  if (!googlebot::RobotsSnapshot(snapshot).Verify()) {
+    std::cerr << "the snapshot built is malformed" << std::endl;
+    return 1;
+  }
+  const std::string temporary = output + ".tmp";
+  if (!WriteFile(temporary, snapshot)) {
+    std::cerr << "failed to write file \"" << temporary << "\"" << std::endl;
+    std::remove(temporary.c_str());
+    return 1;
+  }
+  if (std::rename(temporary.c_str(), output.c_str()) != 0) {
+    std::cerr << "failed to rename \"" << temporary << "\" to \"" << output
+              << "\"" << std::endl;
+    std::remove(temporary.c_str());
+    return 1;
+  }
+
+  std::cout << "wrote " << builder.num_hosts() << " hosts with "
+            << builder.num_blocks() << " distinct rules, " << snapshot.size()
+            << " bytes, to \"" << output << "\"" << std::endl;
+  return 0;
+}
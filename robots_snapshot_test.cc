@@ -0,0 +1,332 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: robots_snapshot_test.cc
+// -----------------------------------------------------------------------------
+//
+// This file tests the snapshot of the compiled robots.txt rules of many hosts.
+
+#include "robots_snapshot.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "robots.h"
+
+namespace {
+
+using ::googlebot::CompiledRobots;
+using ::googlebot::CompiledRobotsView;
+using ::googlebot::LiveRobotsSnapshot;
+using ::googlebot::RobotsSnapshot;
+using ::googlebot::RobotsSnapshotBuilder;
+using ::googlebot::SnapshotLookup;
+
+constexpr char kRobotsTxt[] =
+    "user-agent: FooBot\n"
+    "disallow: /private\n";
+
+TEST(RobotsSnapshotTest, FindHosts) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", kRobotsTxt);
+  builder.Add("Bar.com", kRobotsTxt);
+  builder.Add("baz.com", "user-agent: *\ndisallow: /\n");
+  EXPECT_EQ(3, builder.num_hosts());
+  EXPECT_EQ(2, builder.num_blocks());
+  const std::string data = builder.Build();
+
+  const RobotsSnapshot snapshot(data);
+  ASSERT_TRUE(snapshot.valid());
+  EXPECT_EQ(3, snapshot.num_hosts());
+  const CompiledRobotsView foo = snapshot.Find("foo.com");
+  ASSERT_TRUE(foo.valid());
+  EXPECT_FALSE(foo.IsAllowed("FooBot", "http://foo.com/private"));
+  EXPECT_TRUE(foo.IsAllowed("FooBot", "http://foo.com/public"));
+  EXPECT_TRUE(foo.IsAllowed("BarBot", "http://foo.com/private"));
+
+  // Hosts are compared ignoring case.
+  for (const char* host : {"bar.com", "BAR.COM"}) {
+    const CompiledRobotsView bar = snapshot.Find(host);
+    ASSERT_TRUE(bar.valid()) << host;
+    EXPECT_FALSE(bar.IsAllowed("FooBot", "http://bar.com/private"));
+  }
+  EXPECT_TRUE(snapshot.Find("baz.com").disallows_all());
+  SnapshotLookup lookup;
+  EXPECT_TRUE(snapshot.Find("baz.com", &lookup).valid());
+  EXPECT_EQ(SnapshotLookup::FOUND, lookup);
+  EXPECT_FALSE(snapshot.Find("qux.com", &lookup).valid());
+  EXPECT_EQ(SnapshotLookup::NOT_FOUND, lookup);
+  EXPECT_FALSE(snapshot.Find("", &lookup).valid());
+  EXPECT_EQ(SnapshotLookup::NOT_FOUND, lookup);
+
+  // Identical rules are stored once.
+  const std::string block = CompiledRobots(kRobotsTxt).Serialize();
+  EXPECT_EQ(data.find(block), data.rfind(block));
+}
+
+TEST(RobotsSnapshotTest, ReplacesRulesOfHost) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", "user-agent: *\ndisallow: /\n");
+  builder.Add("FOO.com", kRobotsTxt);
+  EXPECT_EQ(1, builder.num_hosts());
+  const std::string data = builder.Build();
+  const RobotsSnapshot snapshot(data);
+  EXPECT_TRUE(snapshot.Find("foo.com").IsAllowed("BarBot", "http://foo.com/"));
+  // The rules no host uses anymore aren't written.
+  EXPECT_EQ(std::string::npos,
+            data.find(CompiledRobots("user-agent: *\ndisallow: /\n")
+                          .Serialize()));
+}
+
+TEST(RobotsSnapshotTest, ManyHosts) {
+  RobotsSnapshotBuilder builder;
+  constexpr int kNumHosts = 10000;
+  for (int i = 0; i < kNumHosts; ++i) {
+    builder.Add(absl::StrCat("host-", i, ".com"),
+                absl::StrCat("user-agent: *\ndisallow: /", i % 100, "/\n"));
+  }
+  EXPECT_EQ(100, builder.num_blocks());
+  const std::string data = builder.Build();
+  const RobotsSnapshot snapshot(data);
+  ASSERT_EQ(kNumHosts, snapshot.num_hosts());
+  for (int i = 0; i < kNumHosts; ++i) {
+    const CompiledRobotsView rules =
+        snapshot.Find(absl::StrCat("host-", i, ".com"));
+    ASSERT_TRUE(rules.valid()) << i;
+    EXPECT_FALSE(
+        rules.IsAllowed("FooBot", absl::StrCat("http://h/", i % 100, "/a")));
+    EXPECT_TRUE(rules.IsAllowed("FooBot",
+                                absl::StrCat("http://h/", i % 100 + 1, "/a")));
+  }
+  EXPECT_FALSE(snapshot.Find(absl::StrCat("host-", kNumHosts, ".com")).valid());
+}
+
+// The same hosts and rules give the same snapshot, whatever their order.
+TEST(RobotsSnapshotTest, Deterministic) {
+  RobotsSnapshotBuilder forward;
+  RobotsSnapshotBuilder backward;
+  for (int i = 0; i < 100; ++i) {
+    forward.Add(absl::StrCat("host-", i),
+                absl::StrCat("user-agent: *\ndisallow: /", i));
+    backward.Add(absl::StrCat("host-", 99 - i),
+                 absl::StrCat("user-agent: *\ndisallow: /", 99 - i));
+  }
+  EXPECT_EQ(forward.Build(), backward.Build());
+}
+
+TEST(RobotsSnapshotTest, OpenFile) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", kRobotsTxt);
+  const std::string data = builder.Build();
+  const std::string path = testing::TempDir() + "/robots_snapshot_test.bin";
+  {
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    file.write(data.data(), data.size());
+    ASSERT_TRUE(file.good());
+  }
+  const std::unique_ptr<RobotsSnapshot> snapshot = RobotsSnapshot::Open(path);
+  ASSERT_NE(nullptr, snapshot);
+  EXPECT_EQ(data, snapshot->data());
+  EXPECT_FALSE(
+      snapshot->Find("foo.com").IsAllowed("FooBot", "http://foo.com/private"));
+
+  EXPECT_NE(nullptr, RobotsSnapshot::Open(path, /*verify=*/true));
+
+  EXPECT_EQ(nullptr, RobotsSnapshot::Open(path + ".missing"));
+  {
+    std::string bad_rules = data;
+    bad_rules[40] = 'X';
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    file.write(bad_rules.data(), bad_rules.size());
+  }
+  EXPECT_NE(nullptr, RobotsSnapshot::Open(path));
+  EXPECT_EQ(nullptr, RobotsSnapshot::Open(path, /*verify=*/true));
+  {
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    file.write(data.data(), data.size() / 2);
+  }
+  EXPECT_EQ(nullptr, RobotsSnapshot::Open(path));
+  std::remove(path.c_str());
+}
+
+TEST(RobotsSnapshotTest, InvalidData) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", kRobotsTxt);
+  const std::string data = builder.Build();
+
+  std::string bad_magic = data;
+  bad_magic[0] = 'X';
+  std::string bad_slots = data;
+  bad_slots[24] = 3;  // Not a power of two.
+  for (const absl::string_view bad :
+       {absl::string_view(), absl::string_view(data).substr(0, 39),
+        absl::string_view(data).substr(0, data.size() - 1),
+        absl::string_view(bad_magic), absl::string_view(bad_slots)}) {
+    const RobotsSnapshot snapshot(bad);
+    EXPECT_FALSE(snapshot.valid());
+    EXPECT_EQ(0, snapshot.num_hosts());
+    SnapshotLookup lookup;
+    EXPECT_FALSE(snapshot.Find("foo.com", &lookup).valid());
+    EXPECT_EQ(SnapshotLookup::CORRUPT, lookup);
+  }
+
+  // Broken rules of a host give an invalid view, on every lookup.
+  std::string bad_rules = data;
+  bad_rules[40] = 'X';
+  const RobotsSnapshot bad_snapshot(bad_rules);
+  ASSERT_TRUE(bad_snapshot.valid());
+  for (int i = 0; i < 2; ++i) {
+    SnapshotLookup lookup;
+    EXPECT_FALSE(bad_snapshot.Find("foo.com", &lookup).valid());
+    EXPECT_EQ(SnapshotLookup::CORRUPT, lookup);
+  }
+  // Other hosts are still told apart from corrupt ones.
+  SnapshotLookup lookup;
+  bad_snapshot.Find("bar.com", &lookup);
+  EXPECT_EQ(SnapshotLookup::NOT_FOUND, lookup);
+  EXPECT_FALSE(bad_snapshot.Verify());
+  EXPECT_TRUE(RobotsSnapshot(data).Verify());
+}
+
+// Rules checked by the first lookup of a host are read unchecked by the next
+// ones.
+TEST(RobotsSnapshotTest, ChecksRulesOnce) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", kRobotsTxt);
+  const std::string data = builder.Build();
+  const RobotsSnapshot snapshot(data);
+  ASSERT_TRUE(snapshot.Verify());
+  for (int i = 0; i < 2; ++i) {
+    const CompiledRobotsView foo = snapshot.Find("foo.com");
+    ASSERT_TRUE(foo.valid());
+    EXPECT_FALSE(foo.IsAllowed("FooBot", "http://foo.com/private"));
+  }
+
+  const std::string block = CompiledRobots(kRobotsTxt).Serialize();
+  EXPECT_TRUE(CompiledRobotsView::Unchecked(block).valid());
+  EXPECT_FALSE(CompiledRobotsView::Unchecked(block.substr(1)).valid());
+}
+
+// Returns a snapshot of 'num_hosts' hosts, all disallowing or all allowing
+// everything.
+std::unique_ptr<RobotsSnapshot> MakeSnapshot(int num_hosts, bool disallow) {
+  RobotsSnapshotBuilder builder;
+  for (int i = 0; i < num_hosts; ++i) {
+    builder.Add(absl::StrCat("host-", i),
+                disallow ? "user-agent: *\ndisallow: /\n" : "");
+  }
+  return RobotsSnapshot::Create(builder.Build());
+}
+
+TEST(LiveRobotsSnapshotTest, Publish) {
+  EXPECT_EQ(nullptr, RobotsSnapshot::Create("not a snapshot"));
+
+  LiveRobotsSnapshot live;
+  EXPECT_TRUE(live.IsAllowed("host-0", "FooBot", "http://host-0/"));
+  live.Publish(MakeSnapshot(10, /*disallow=*/true));
+  EXPECT_EQ(1, live.epoch());
+  EXPECT_FALSE(live.IsAllowed("host-0", "FooBot", "http://host-0/"));
+  EXPECT_TRUE(live.IsAllowed("host-10", "FooBot", "http://host-10/"));
+  {
+    const LiveRobotsSnapshot::ReadLock lock(live);
+    ASSERT_NE(nullptr, lock.get());
+    EXPECT_EQ(10, lock.get()->num_hosts());
+  }
+  live.Publish(nullptr);
+  EXPECT_EQ(2, live.epoch());
+  EXPECT_TRUE(live.IsAllowed("host-0", "FooBot", "http://host-0/"));
+}
+
+// Hosts whose rules are corrupt are disallowed rather than allowed.
+TEST(LiveRobotsSnapshotTest, FailsClosedOnCorruptRules) {
+  RobotsSnapshotBuilder builder;
+  builder.Add("foo.com", "");
+  std::string data = builder.Build();
+  data[40] = 'X';
+  LiveRobotsSnapshot live(RobotsSnapshot::Create(data));
+  EXPECT_FALSE(live.IsAllowed("foo.com", "FooBot", "http://foo.com/"));
+  EXPECT_TRUE(live.IsAllowed("bar.com", "FooBot", "http://bar.com/"));
+}
+
+// The previous snapshot stays alive until the readers using it are done.
+TEST(LiveRobotsSnapshotTest, PublishWaitsForReaders) {
+  LiveRobotsSnapshot live(MakeSnapshot(10, /*disallow=*/true));
+  std::atomic<bool> published(false);
+  std::thread publisher;
+  {
+    const LiveRobotsSnapshot::ReadLock lock(live);
+    publisher = std::thread([&live, &published]() {
+      live.Publish(MakeSnapshot(10, /*disallow=*/false));
+      published = true;
+    });
+    // Publish() has moved to the next epoch once new readers see the new
+    // snapshot.
+    while (live.epoch() == 0) absl::SleepFor(absl::Milliseconds(1));
+    EXPECT_TRUE(live.IsAllowed("host-0", "FooBot", "http://host-0/"));
+    absl::SleepFor(absl::Milliseconds(50));
+    EXPECT_FALSE(published);
+    EXPECT_FALSE(lock.get()->Find("host-0").IsAllowed("FooBot",
+                                                      "http://host-0/"));
+  }
+  publisher.join();
+  EXPECT_TRUE(published);
+}
+
+// Readers hammering the snapshot while it's replaced over and over always see
+// one whole snapshot.
+TEST(LiveRobotsSnapshotTest, LookupsDuringSwaps) {
+  constexpr int kNumHosts = 100;
+  LiveRobotsSnapshot live(MakeSnapshot(kNumHosts, /*disallow=*/false));
+  std::atomic<bool> done(false);
+  std::atomic<int> inconsistencies(0);
+  std::atomic<int64_t> lookups(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+      for (int i = t; !done; ++i) {
+        const LiveRobotsSnapshot::ReadLock lock(live);
+        const std::string host = absl::StrCat("host-", i % kNumHosts);
+        const std::string other_host =
+            absl::StrCat("host-", (i + 1) % kNumHosts);
+        if (lock.get()->Find(host).IsAllowed("FooBot", "http://h/") !=
+            lock.get()->Find(other_host).IsAllowed("FooBot", "http://h/")) {
+          inconsistencies.fetch_add(1);
+        }
+        live.IsAllowed(host, "FooBot", "http://h/");
+        lookups.fetch_add(2, std::memory_order_relaxed);
+      }
+    });
+  }
+  constexpr int kNumSwaps = 100;
+  for (int i = 0; i < kNumSwaps; ++i) {
+    live.Publish(MakeSnapshot(kNumHosts, /*disallow=*/i % 2 == 0));
+  }
+  done = true;
+  for (std::thread& reader : readers) reader.join();
+  EXPECT_EQ(kNumSwaps, live.epoch());
+  EXPECT_EQ(0, inconsistencies.load());
+  EXPECT_LT(0, lookups.load());
+}
+
+}  // namespace
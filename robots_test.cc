@@ -17,20 +17,74 @@
 // https://www.rfc-editor.org/rfc/rfc9309.html
 #include "robots.h"
 
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "robots_allocation_counter.h"
 
 namespace {
 
+using ::googlebot::CompiledRobots;
 using ::googlebot::RobotsMatcher;
 
 bool IsUserAgentAllowed(const absl::string_view robotstxt,
                         const std::string& useragent, const std::string& url) {
+  SCOPED_TRACE(absl::StrCat("robots.txt:\n", robotstxt, "\nuser-agent: ",
+                            useragent, "\nurl: ", url));
   RobotsMatcher matcher;
-  return matcher.OneAgentAllowedByRobots(robotstxt, useragent, url);
+  const bool allowed =
+      matcher.OneAgentAllowedByRobots(robotstxt, useragent, url);
+  // The compiled form must agree with the matcher on every verdict.
+  const CompiledRobots robots(robotstxt);
+  const googlebot::RobotsVerdict verdict = robots.Evaluate(useragent, url);
+  EXPECT_EQ(allowed, verdict.allowed);
+  EXPECT_EQ(matcher.matching_line(), verdict.matching_line);
+  EXPECT_EQ(allowed, robots.IsAllowed(useragent, url));
+  const googlebot::HostVerdict host_verdict = robots.GetHostVerdict(useragent);
+  if (host_verdict != googlebot::HostVerdict::PER_URL) {
+    EXPECT_EQ(allowed, host_verdict == googlebot::HostVerdict::ALLOW_ALL);
+  }
+  // URLs sharing the decisive path get the same verdict.
+  const std::string other_url = url + "/more";
+  std::string path_buffer;
+  std::string other_path_buffer;
+  absl::string_view decisive_path;
+  absl::string_view other_decisive_path;
+  if (robots.GetDecisivePath(useragent, url, &path_buffer, &decisive_path) &&
+      robots.GetDecisivePath(useragent, other_url, &other_path_buffer,
+                             &other_decisive_path) &&
+      decisive_path == other_decisive_path) {
+    SCOPED_TRACE(absl::StrCat("other url: ", other_url));
+    const googlebot::RobotsVerdict other_verdict =
+        robots.Evaluate(useragent, other_url);
+    EXPECT_EQ(allowed, other_verdict.allowed);
+    EXPECT_EQ(verdict.matching_line, other_verdict.matching_line);
+  }
+  // So must the rules read in place from their flat binary format.
+  const std::string serialized = robots.Serialize();
+  const googlebot::CompiledRobotsView view(serialized);
+  EXPECT_TRUE(view.valid());
+  const googlebot::RobotsVerdict view_verdict = view.Evaluate(useragent, url);
+  EXPECT_EQ(allowed, view_verdict.allowed);
+  EXPECT_EQ(matcher.matching_line(), view_verdict.matching_line);
+  EXPECT_EQ(allowed, view.IsAllowed(useragent, url));
+  EXPECT_EQ(host_verdict, view.GetHostVerdict(useragent));
+  // So must the matcher when it only parses the groups that apply.
+  RobotsMatcher group_matcher;
+  const googlebot::RobotsGroupIndex group_index(robotstxt);
+  EXPECT_EQ(allowed,
+            group_matcher.OneAgentAllowedByRobots(group_index, useragent, url));
+  EXPECT_EQ(matcher.matching_line(), group_matcher.matching_line());
+  return allowed;
 }
 
 // Google-specific: system test.
@@ -387,6 +441,57 @@ TEST(RobotsUnittest, ID_LongestMatch) {
   }
 }
 
+// Ignores Allow rules, and matches Disallow rules as the default strategy.
+class IgnoreAllowStrategy {
+ public:
+  int MatchAllow(absl::string_view path, absl::string_view pattern) {
+    return -1;
+  }
+  int MatchDisallow(absl::string_view path, absl::string_view pattern) {
+    return googlebot::LongestMatchRobotsMatchStrategy().MatchDisallow(path,
+                                                                     pattern);
+  }
+};
+
+// The same, chosen at run time.
+class VirtualIgnoreAllowStrategy : public googlebot::RobotsMatchStrategy {
+ public:
+  int MatchAllow(absl::string_view path, absl::string_view pattern) override {
+    return strategy_.MatchAllow(path, pattern);
+  }
+  int MatchDisallow(absl::string_view path,
+                    absl::string_view pattern) override {
+    return strategy_.MatchDisallow(path, pattern);
+  }
+
+ private:
+  IgnoreAllowStrategy strategy_;
+};
+
+// Custom match strategies replace the longest match, whether fixed at compile
+// time or chosen at run time.
+TEST(RobotsUnittest, CustomMatchStrategy) {
+  const absl::string_view robotstxt =
+      "user-agent: FooBot\n"
+      "allow: /x/page.html\n"
+      "disallow: /x/\n";
+  const std::string url = "http://foo.bar/x/page.html";
+  EXPECT_TRUE(IsUserAgentAllowed(robotstxt, "FooBot", url));
+
+  googlebot::BasicRobotsMatcher<IgnoreAllowStrategy> matcher;
+  EXPECT_FALSE(matcher.OneAgentAllowedByRobots(robotstxt, "FooBot", url));
+  EXPECT_EQ(3, matcher.matching_line());
+  EXPECT_TRUE(matcher.OneAgentAllowedByRobots(robotstxt, "FooBot",
+                                              "http://foo.bar/y/page.html"));
+
+  googlebot::BasicRobotsMatcher<googlebot::DynamicRobotsMatchStrategy>
+      dynamic_matcher(googlebot::DynamicRobotsMatchStrategy(
+          std::make_unique<VirtualIgnoreAllowStrategy>()));
+  EXPECT_FALSE(dynamic_matcher.OneAgentAllowedByRobots(robotstxt, "FooBot",
+                                                       url));
+  EXPECT_EQ(3, dynamic_matcher.matching_line());
+}
+
 // Octets in the URI and robots.txt paths outside the range of the US-ASCII
 // coded character set, and those in the reserved range defined by RFC3986,
 // MUST be percent-encoded as defined by RFC3986 prior to comparison.
@@ -962,17 +1067,721 @@ TEST(RobotsUnittest, ID_NonStandardLineExample_Sitemap) {
   }
 }
 
+// Google-specific: keys are matched case-insensitively on their prefix, and
+// some frequent typos are accepted.
+TEST(RobotsUnittest, GoogleOnly_GetKeyType) {
+  using ::googlebot::KeyType;
+  const std::vector<std::pair<std::string, std::pair<KeyType, bool>>> cases = {
+      {"user-agent", {KeyType::USER_AGENT, false}},
+      {"User-Agent", {KeyType::USER_AGENT, false}},
+      {"user-agents", {KeyType::USER_AGENT, false}},
+      {"useragent", {KeyType::USER_AGENT, true}},
+      {"USER AGENT", {KeyType::USER_AGENT, true}},
+      {"user", {KeyType::UNKNOWN, false}},
+      {"allow", {KeyType::ALLOW, false}},
+      {"ALLOWED", {KeyType::ALLOW, false}},
+      {"alow", {KeyType::UNKNOWN, false}},
+      {"disallow", {KeyType::DISALLOW, false}},
+      {"Disallow", {KeyType::DISALLOW, false}},
+      {"dissallow", {KeyType::DISALLOW, true}},
+      {"dissalow", {KeyType::DISALLOW, true}},
+      {"disalow", {KeyType::DISALLOW, true}},
+      {"diasllow", {KeyType::DISALLOW, true}},
+      {"DISALLAW", {KeyType::DISALLOW, true}},
+      {"disalloww", {KeyType::DISALLOW, false}},
+      {"dis", {KeyType::UNKNOWN, false}},
+      {"sitemap", {KeyType::SITEMAP, false}},
+      {"Site-Map", {KeyType::SITEMAP, true}},
+      {"site", {KeyType::UNKNOWN, false}},
+      {"crawl-delay", {KeyType::UNKNOWN, false}},
+      {"host", {KeyType::UNKNOWN, false}},
+      {"", {KeyType::UNKNOWN, false}},
+  };
+  for (const auto& test_case : cases) {
+    bool is_acceptable_typo = !test_case.second.second;
+    EXPECT_EQ(test_case.second.first,
+              googlebot::GetKeyType(test_case.first, &is_acceptable_typo))
+        << "key: " << test_case.first;
+    EXPECT_EQ(test_case.second.second, is_acceptable_typo)
+        << "key: " << test_case.first;
+  }
+}
+
+// Records the values passed to the parse callbacks.
+class ValueRecorder : public googlebot::RobotsParseHandler {
+ public:
+  void HandleRobotsStart() override {}
+  void HandleRobotsEnd() override {}
+  void HandleUserAgent(int line_num, absl::string_view value) override {
+    values_.push_back(value);
+  }
+  void HandleAllow(int line_num, absl::string_view value) override {
+    values_.push_back(value);
+  }
+  void HandleDisallow(int line_num, absl::string_view value) override {
+    // Escaped values only live as long as the callback.
+    escaped_.emplace_back(value);
+    values_.push_back(value);
+  }
+  void HandleSitemap(int line_num, absl::string_view value) override {}
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {}
+
+  const std::vector<absl::string_view>& values() const { return values_; }
+  const std::vector<std::string>& escaped() const { return escaped_; }
+
+ private:
+  std::vector<absl::string_view> values_;
+  std::vector<std::string> escaped_;
+};
+
+// Google-specific: the parser doesn't copy lines. Values are passed to the
+// handler as views into the robots.txt body, unless they had to be escaped.
+// A line ends at the first '\0'.
+TEST(RobotsUnittest, GoogleOnly_ValuesPointIntoRobotsBody) {
+  const std::string robotstxt = absl::StrCat(
+      "user-agent: FooBot  # comment\n"
+      "allow: /a/b\r\n"
+      "disallow: /f\xC3\xBC\n"
+      "disallow: /c",
+      absl::string_view("\0/d\n", 4));
+  ValueRecorder recorder;
+  googlebot::ParseRobotsTxt(robotstxt, &recorder);
+  ASSERT_EQ(4, recorder.values().size());
+  const auto in_body = [&robotstxt](absl::string_view value) {
+    return value.data() >= robotstxt.data() &&
+           value.data() + value.size() <= robotstxt.data() + robotstxt.size();
+  };
+  EXPECT_EQ("FooBot", recorder.values()[0]);
+  EXPECT_TRUE(in_body(recorder.values()[0]));
+  EXPECT_EQ("/a/b", recorder.values()[1]);
+  EXPECT_TRUE(in_body(recorder.values()[1]));
+  EXPECT_EQ("/f%C3%BC", recorder.escaped()[0]);
+  EXPECT_FALSE(in_body(recorder.values()[2]));
+  EXPECT_EQ("/c", recorder.values()[3]);
+  EXPECT_TRUE(in_body(recorder.values()[3]));
+}
+
+// Logs every callback of the parser, with its arguments.
+class CallbackLogger : public googlebot::RobotsParseHandler {
+ public:
+  void HandleRobotsStart() override { log_ += "start\n"; }
+  void HandleRobotsEnd() override { log_ += "end\n"; }
+  void HandleUserAgent(int line_num, absl::string_view value) override {
+    absl::StrAppend(&log_, line_num, " user-agent: ", value, "\n");
+  }
+  void HandleAllow(int line_num, absl::string_view value) override {
+    absl::StrAppend(&log_, line_num, " allow: ", value, "\n");
+  }
+  void HandleDisallow(int line_num, absl::string_view value) override {
+    absl::StrAppend(&log_, line_num, " disallow: ", value, "\n");
+  }
+  void HandleSitemap(int line_num, absl::string_view value) override {
+    absl::StrAppend(&log_, line_num, " sitemap: ", value, "\n");
+  }
+  void HandleUnknownAction(int line_num, absl::string_view action,
+                           absl::string_view value) override {
+    absl::StrAppend(&log_, line_num, " ", action, ": ", value, "\n");
+  }
+  void ReportLineMetadata(int line_num, const LineMetadata& metadata) override {
+    absl::StrAppend(&log_, line_num, " metadata:", metadata.is_empty,
+                    metadata.has_comment, metadata.is_comment,
+                    metadata.has_directive, metadata.is_acceptable_typo,
+                    metadata.is_line_too_long,
+                    metadata.is_missing_colon_separator, "\n");
+  }
+
+  const std::string& log() const { return log_; }
+
+ private:
+  std::string log_;
+};
+
+// Google-specific: a robots.txt parsed in chunks gives the same callbacks as
+// when it's parsed at once, wherever the chunks are split.
+TEST(RobotsUnittest, GoogleOnly_StreamParserMatchesParseRobotsTxt) {
+  const std::string long_line =
+      absl::StrCat("disallow: /", std::string(20000, 'x'), "\n");
+  const std::vector<std::string> robotstxts = {
+      "",
+      "\xEF\xBB\xBFuser-agent: FooBot\r\ndisallow: /a\r\n\r\nallow: /b",
+      "\xEF\xBBuser-agent: FooBot\rdisallow: /a\r\rallow: /b\n\n",
+      "\xEFuser-agent: FooBot\n\r\ndisallow: /f\xC3\xBC # comment\r",
+      absl::StrCat("user-agent: *\n", long_line, "allow: /c\n", long_line),
+      absl::StrCat("user-agent: *\r\n",
+                   absl::string_view("disallow: /a\0b\r\n", 16),
+                   "useragent BarBot\r\nsitemap: http://foo.bar/s.xml"),
+  };
+  for (const std::string& robotstxt : robotstxts) {
+    CallbackLogger expected;
+    googlebot::ParseRobotsTxt(robotstxt, &expected);
+
+    const absl::string_view body = robotstxt;
+    for (size_t split = 0; split <= body.size();
+         split += (body.size() > 1000 ? 997 : 1)) {
+      CallbackLogger logger;
+      googlebot::RobotsTxtStreamParser parser(&logger);
+      parser.Feed(body.substr(0, split));
+      parser.Feed("");
+      parser.Feed(body.substr(split));
+      parser.Finish();
+      EXPECT_EQ(expected.log(), logger.log()) << "split at " << split;
+    }
+
+    CallbackLogger logger;
+    googlebot::RobotsTxtStreamParser parser(&logger);
+    for (const char c : body) parser.Feed(absl::string_view(&c, 1));
+    parser.Finish();
+    EXPECT_EQ(expected.log(), logger.log());
+  }
+}
+
+// Parses 'robotstxt' within 'limits' at once and in chunks, checking that both
+// give the same callbacks and report. Returns the callbacks.
+std::string ParseWithLimits(absl::string_view robotstxt,
+                            const googlebot::RobotsParseLimits& limits,
+                            googlebot::RobotsParseReport* report) {
+  CallbackLogger logger;
+  googlebot::RobotsParseContext context;
+  *report = googlebot::ParseRobotsTxt(robotstxt, &logger, limits, &context);
+
+  CallbackLogger stream_logger;
+  googlebot::RobotsTxtStreamParser parser(&stream_logger, limits);
+  for (size_t pos = 0; pos < robotstxt.size(); pos += 5) {
+    parser.Feed(robotstxt.substr(pos, 5));
+  }
+  parser.Finish();
+  EXPECT_EQ(logger.log(), stream_logger.log());
+  EXPECT_EQ(report->lines, parser.report().lines);
+  EXPECT_EQ(report->rules, parser.report().rules);
+  EXPECT_EQ(report->limit_reached(), parser.report().limit_reached());
+  return logger.log();
+}
+
+TEST(RobotsUnittest, ParseLimits) {
+  const std::string robotstxt =
+      "user-agent: FooBot\n"   // 19 bytes.
+      "disallow: /a\n"         // 13 bytes.
+      "disallow: /b\n"
+      "user-agent: BarBot\n"
+      "disallow: /c\n"
+      "allow: /d";
+  googlebot::RobotsParseReport report;
+  googlebot::RobotsParseLimits limits;
+  const std::string all_lines = ParseWithLimits(robotstxt, limits, &report);
+  EXPECT_FALSE(report.limit_reached());
+  EXPECT_EQ(6, report.lines);
+  EXPECT_EQ(4, report.rules);
+
+  // Stops in the middle of the third line.
+  limits.max_bytes = 19 + 13 + 5;
+  std::string log = ParseWithLimits(robotstxt, limits, &report);
+  EXPECT_TRUE(report.exceeded_max_bytes);
+  EXPECT_EQ(2, report.lines);
+  EXPECT_EQ(1, report.rules);
+  EXPECT_EQ(std::string::npos, log.find("/b"));
+  EXPECT_NE(std::string::npos, log.find("end"));
+
+  // A body as long as the byte limit is parsed whole.
+  limits.max_bytes = robotstxt.size();
+  EXPECT_EQ(all_lines, ParseWithLimits(robotstxt, limits, &report));
+  EXPECT_FALSE(report.limit_reached());
+  limits = googlebot::RobotsParseLimits();
+
+  limits.max_lines = 4;
+  log = ParseWithLimits(robotstxt, limits, &report);
+  EXPECT_TRUE(report.exceeded_max_lines);
+  EXPECT_EQ(4, report.lines);
+  EXPECT_EQ(std::string::npos, log.find("/c"));
+  // The empty line after the last line ending doesn't count.
+  limits.max_lines = 6;
+  EXPECT_EQ(all_lines,
+            ParseWithLimits(absl::StrCat(robotstxt, "\n"), limits, &report));
+  EXPECT_FALSE(report.limit_reached());
+  limits = googlebot::RobotsParseLimits();
+
+  limits.max_rules_per_group = 1;
+  log = ParseWithLimits(robotstxt, limits, &report);
+  EXPECT_TRUE(report.exceeded_max_rules_per_group);
+  EXPECT_EQ(2, report.lines);
+  EXPECT_EQ(1, report.rules);
+  limits.max_rules_per_group = 2;
+  EXPECT_EQ(all_lines, ParseWithLimits(robotstxt, limits, &report));
+  EXPECT_FALSE(report.limit_reached());
+  limits = googlebot::RobotsParseLimits();
+
+  limits.max_rules = 3;
+  log = ParseWithLimits(robotstxt, limits, &report);
+  EXPECT_TRUE(report.exceeded_max_rules);
+  EXPECT_EQ(5, report.lines);
+  EXPECT_EQ(3, report.rules);
+  EXPECT_EQ(std::string::npos, log.find("/d"));
+}
+
+TEST(CompiledRobotsUnittest, ParseLimits) {
+  std::string robotstxt = "user-agent: *\n";
+  for (int i = 0; i < 1000; ++i) {
+    absl::StrAppend(&robotstxt, "disallow: /", i, "/\n");
+  }
+  googlebot::RobotsParseLimits limits;
+  limits.max_rules = 100;
+  const CompiledRobots robots(robotstxt, limits);
+  EXPECT_TRUE(robots.parse_report().exceeded_max_rules);
+  EXPECT_EQ(100, robots.parse_report().rules);
+  EXPECT_FALSE(robots.IsAllowed("FooBot", "http://foo.bar/99/"));
+  EXPECT_TRUE(robots.IsAllowed("FooBot", "http://foo.bar/100/"));
+  EXPECT_FALSE(CompiledRobots(robotstxt).parse_report().limit_reached());
+}
+
+// A CompiledRobots is built once and answers for any number of URLs and user
+// agents.
+TEST(CompiledRobotsUnittest, ParseOnceQueryMany) {
+  const CompiledRobots robots(
+      "user-agent: FooBot\n"
+      "disallow: /\n"
+      "allow: /public/\n"
+      "allow: /x/index.html\n"
+      "\n"
+      "user-agent: BarBot\n"
+      "user-agent: BazBot\n"
+      "disallow: /*.pdf$\n"
+      "\n"
+      "user-agent: *\n"
+      "disallow: /private\n");
+
+  EXPECT_FALSE(robots.IsAllowed("FooBot", "http://foo.bar/"));
+  EXPECT_TRUE(robots.IsAllowed("FooBot", "http://foo.bar/public/a.html"));
+  EXPECT_TRUE(robots.IsAllowed("foobot", "http://foo.bar/x/"));
+  EXPECT_FALSE(robots.IsAllowed("FooBot", "http://foo.bar/x/a"));
+  EXPECT_TRUE(robots.IsAllowed("FooBot", "http://foo.bar/x/index.html"));
+
+  EXPECT_FALSE(robots.IsAllowed("BazBot", "http://foo.bar/a.pdf"));
+  EXPECT_TRUE(robots.IsAllowed("BazBot", "http://foo.bar/a.pdf?x"));
+  EXPECT_TRUE(robots.IsAllowed("BarBot", "http://foo.bar/private"));
+
+  EXPECT_FALSE(robots.IsAllowed("QuxBot", "http://foo.bar/private/a"));
+  EXPECT_TRUE(robots.IsAllowed("QuxBot", "http://foo.bar/a.pdf"));
+
+  const std::vector<std::string> agents = {"QuxBot", "BarBot"};
+  EXPECT_TRUE(robots.AllowedByRobots(agents, "http://foo.bar/private/a"));
+  EXPECT_FALSE(robots.AllowedByRobots(agents, "http://foo.bar/a.pdf"));
+}
+
+// Rules before the first user-agent line are ignored, and consecutive
+// user-agent lines share the rules that follow them, as with RobotsMatcher.
+TEST(CompiledRobotsUnittest, GroupsAreSplitLikeRobotsMatcher) {
+  const absl::string_view robotstxt =
+      "allow: /\n"
+      "disallow: /a\n"
+      "user-agent: FooBot\n"
+      "sitemap: http://foo.bar/sitemap.xml\n"
+      "user-agent: BarBot\n"
+      "disallow: /b\n"
+      "user-agent: BazBot\n"
+      "unknown: /c\n"
+      "user-agent: *\n"
+      "disallow: /d\n"
+      "user-agent: QuxBot\n";
+  for (const char* agent : {"FooBot", "BarBot", "BazBot", "QuxBot", "Other"}) {
+    for (const char* url : {"http://foo.bar/a", "http://foo.bar/b",
+                            "http://foo.bar/d", "http://foo.bar/"}) {
+      IsUserAgentAllowed(robotstxt, agent, url);
+    }
+  }
+}
+
+// Robots.txt files allowing or disallowing everything are recognized, for all
+// user agents or only some of them.
+TEST(CompiledRobotsUnittest, HostVerdict) {
+  using googlebot::HostVerdict;
+  {
+    const CompiledRobots robots("");
+    EXPECT_TRUE(robots.allows_all());
+    EXPECT_FALSE(robots.disallows_all());
+    EXPECT_EQ(HostVerdict::ALLOW_ALL, robots.GetHostVerdict("FooBot"));
+  }
+  {
+    const CompiledRobots robots(
+        "user-agent: *\n"
+        "disallow:\n"
+        "allow: /public\n");
+    EXPECT_TRUE(robots.allows_all());
+    EXPECT_TRUE(robots.IsAllowed("FooBot", "http://foo.bar/private"));
+  }
+  for (const char* pattern : {"/", "/*", "*", "/**"}) {
+    const CompiledRobots robots(
+        absl::StrCat("user-agent: *\nallow:\ndisallow: ", pattern, "\n"));
+    EXPECT_FALSE(robots.allows_all()) << pattern;
+    EXPECT_TRUE(robots.disallows_all()) << pattern;
+    EXPECT_EQ(HostVerdict::DISALLOW_ALL, robots.GetHostVerdict("FooBot"));
+    EXPECT_FALSE(robots.IsAllowed("FooBot", "http://foo.bar/"));
+  }
+  // An Allow rule may win over 'disallow: /'.
+  const absl::string_view robotstxt =
+      "user-agent: *\n"
+      "disallow: /\n"
+      "allow: /public\n"
+      "\n"
+      "user-agent: FooBot\n"
+      "disallow: /*\n"
+      "\n"
+      "user-agent: BarBot\n"
+      "allow: /\n"
+      "\n"
+      "user-agent: BazBot\n"
+      "disallow: /private\n"
+      "\n"
+      "user-agent: QuxBot\n";
+  const CompiledRobots robots(robotstxt);
+  EXPECT_FALSE(robots.allows_all());
+  EXPECT_FALSE(robots.disallows_all());
+  EXPECT_EQ(HostVerdict::PER_URL, robots.GetHostVerdict("OtherBot"));
+  EXPECT_EQ(HostVerdict::DISALLOW_ALL, robots.GetHostVerdict("FooBot"));
+  EXPECT_EQ(HostVerdict::ALLOW_ALL, robots.GetHostVerdict("barbot"));
+  EXPECT_EQ(HostVerdict::PER_URL, robots.GetHostVerdict("BazBot"));
+  EXPECT_EQ(HostVerdict::ALLOW_ALL, robots.GetHostVerdict("QuxBot"));
+  // The groups of all user agents are merged.
+  EXPECT_EQ(HostVerdict::DISALLOW_ALL,
+            robots.GetHostVerdict(std::vector<std::string>{"FooBot", "QuxBot"}));
+  EXPECT_EQ(HostVerdict::PER_URL,
+            robots.GetHostVerdict(std::vector<std::string>{"FooBot", "BarBot"}));
+  for (const char* agent :
+       {"OtherBot", "FooBot", "BarBot", "BazBot", "QuxBot"}) {
+    for (const char* url : {"http://foo.bar/", "http://foo.bar/public",
+                            "http://foo.bar/private"}) {
+      IsUserAgentAllowed(robotstxt, agent, url);
+    }
+  }
+}
+
+// Wildcard rules are matched longest first, and the earliest of the longest
+// matches is reported, as with RobotsMatcher.
+TEST(CompiledRobotsUnittest, WildcardRulesLongestFirst) {
+  const absl::string_view robotstxt =
+      "user-agent: FooBot\n"
+      "disallow: /*x\n"
+      "disallow: /a*b*\n"
+      "disallow: /*b*c\n"
+      "allow: /a*\n"
+      "allow: /ab*c*d\n"
+      "allow: /abx\n";
+  const CompiledRobots robots(robotstxt);
+  googlebot::RobotsVerdict verdict =
+      robots.Evaluate("FooBot", "http://foo.bar/abxc");
+  EXPECT_FALSE(verdict.allowed);
+  EXPECT_EQ(3, verdict.matching_line);
+  verdict = robots.Evaluate("FooBot", "http://foo.bar/abxcd");
+  EXPECT_TRUE(verdict.allowed);
+  EXPECT_EQ(6, verdict.matching_line);
+  // A shorter literal Allow matching doesn't win.
+  verdict = robots.Evaluate("FooBot", "http://foo.bar/abxy");
+  EXPECT_FALSE(verdict.allowed);
+  EXPECT_EQ(3, verdict.matching_line);
+  for (const char* url : {"http://foo.bar/abxc", "http://foo.bar/abxcd",
+                          "http://foo.bar/abxy", "http://foo.bar/ax",
+                          "http://foo.bar/b"}) {
+    IsUserAgentAllowed(robotstxt, "FooBot", url);
+  }
+}
+
+// Many threads share one CompiledRobots and must all get the verdicts a
+// single-threaded RobotsMatcher gives.
+TEST(CompiledRobotsUnittest, ConcurrentQueries) {
+  std::string robotstxt =
+      "user-agent: FooBot\n"
+      "disallow: /private\n"
+      "allow: /private/public\n"
+      "disallow: /*.pdf$\n"
+      "user-agent: *\n"
+      "disallow: /\n"
+      "allow: /index.html\n";
+  for (int i = 0; i < 100; ++i) {
+    absl::StrAppend(&robotstxt, "user-agent: Bot", i, "\n", "disallow: /dir",
+                    i, "/\n", "allow: /dir", i, "/*.html$\n");
+  }
+  const std::shared_ptr<const CompiledRobots> robots =
+      CompiledRobots::Create(robotstxt);
+
+  const std::vector<std::string> agents = {"FooBot", "Bot7", "Bot42", "Other"};
+  std::vector<std::string> urls;
+  for (int i = 0; i < 20; ++i) {
+    for (const char* suffix :
+         {"/", "/index.html", "/private/a", "/private/public/a", "/a.pdf",
+          "/a.pdf?q", "/x.html", "/y"}) {
+      urls.push_back(absl::StrCat("http://foo.bar/dir", i, suffix));
+      urls.push_back(absl::StrCat("http://foo.bar", suffix));
+    }
+  }
+  std::vector<std::vector<bool>> expected(agents.size());
+  for (size_t a = 0; a < agents.size(); ++a) {
+    for (const std::string& url : urls) {
+      RobotsMatcher matcher;
+      expected[a].push_back(
+          matcher.OneAgentAllowedByRobots(robotstxt, agents[a], url));
+    }
+  }
+
+  constexpr int kNumThreads = 8;
+  constexpr int kNumRounds = 3;
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < kNumRounds; ++round) {
+        for (size_t a = 0; a < agents.size(); ++a) {
+          // Spread the threads over the URLs to interleave the queries.
+          for (size_t u = 0; u < urls.size(); ++u) {
+            const size_t i = (u + t * 7) % urls.size();
+            if (robots->IsAllowed(agents[a], urls[i]) != expected[a][i]) {
+              mismatches.fetch_add(1, std::memory_order_relaxed);
+            }
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(0, mismatches.load());
+}
+
+// Checking many URLs at once gives the same verdicts and matching lines as
+// checking them one by one.
+TEST(CompiledRobotsUnittest, AllowedByRobotsBatch) {
+  const absl::string_view robotstxt =
+      "user-agent: *\n"
+      "disallow: /\n"
+      "user-agent: FooBot\n"
+      "allow: /a\n"
+      "disallow: /a/b\n"
+      "disallow: /*.pdf$\n";
+  const std::vector<std::string> agents = {"FooBot"};
+  const std::vector<absl::string_view> urls = {
+      "http://foo.bar/",     "http://foo.bar/a",     "http://foo.bar/a/b",
+      "http://foo.bar/a.pdf", "http://foo.bar/a.pdf?", ""};
+  const std::vector<googlebot::RobotsVerdict> verdicts =
+      googlebot::AllowedByRobotsBatch(robotstxt, agents, urls);
+  ASSERT_EQ(urls.size(), verdicts.size());
+  for (size_t i = 0; i < urls.size(); ++i) {
+    RobotsMatcher matcher;
+    EXPECT_EQ(matcher.AllowedByRobots(robotstxt, &agents, std::string(urls[i])),
+              verdicts[i].allowed)
+        << urls[i];
+    EXPECT_EQ(matcher.matching_line(), verdicts[i].matching_line) << urls[i];
+  }
+  // FooBot's group doesn't match "/", the global group is ignored.
+  EXPECT_TRUE(verdicts[0].allowed);
+  EXPECT_EQ(0, verdicts[0].matching_line);
+  EXPECT_FALSE(verdicts[2].allowed);
+  EXPECT_EQ(6, verdicts[3].matching_line);
+}
+
+// Each user agent gets its own verdict, unlike with AllowedByRobots() where
+// any of them being allowed is enough.
+TEST(CompiledRobotsUnittest, AllowedByRobotsPerAgent) {
+  const absl::string_view robotstxt =
+      "user-agent: *\n"
+      "disallow: /private\n"
+      "\n"
+      "user-agent: FooBot\n"
+      "user-agent: BarBot\n"
+      "disallow: /\n"
+      "allow: /public\n"
+      "\n"
+      "user-agent: BazBot\n"
+      "user-agent: *\n"
+      "allow: /private/baz\n"
+      "\n"
+      "user-agent: BarBot\n"
+      "disallow: /public/bar\n";
+  const std::vector<std::string> agents = {"FooBot", "BarBot", "BazBot",
+                                           "QuxBot", "foobot"};
+  for (const char* url :
+       {"http://foo.bar/", "http://foo.bar/public/bar", "http://foo.bar/private",
+        "http://foo.bar/private/baz", "http://foo.bar/public"}) {
+    const std::vector<googlebot::RobotsVerdict> verdicts =
+        googlebot::AllowedByRobotsPerAgent(robotstxt, agents, url);
+    ASSERT_EQ(agents.size(), verdicts.size());
+    for (size_t i = 0; i < agents.size(); ++i) {
+      RobotsMatcher matcher;
+      EXPECT_EQ(matcher.OneAgentAllowedByRobots(robotstxt, agents[i], url),
+                verdicts[i].allowed)
+          << agents[i] << " " << url;
+      EXPECT_EQ(matcher.matching_line(), verdicts[i].matching_line)
+          << agents[i] << " " << url;
+    }
+  }
+  const std::vector<googlebot::RobotsVerdict> verdicts =
+      googlebot::AllowedByRobotsPerAgent(robotstxt, agents,
+                                         "http://foo.bar/public/bar");
+  EXPECT_TRUE(verdicts[0].allowed);
+  EXPECT_FALSE(verdicts[1].allowed);
+  EXPECT_EQ(14, verdicts[1].matching_line);
+}
+
+// Random robots.txt files with overlapping literal and wildcard patterns, so
+// that the trie and the wildcard matching of CompiledRobots have to agree with
+// RobotsMatcher on the longest match, including ties.
+TEST(CompiledRobotsUnittest, RandomRobotsTxtAgreeWithRobotsMatcher) {
+  std::mt19937 rng(1234);
+  const auto pick = [&rng](const std::vector<std::string>& choices) {
+    return choices[std::uniform_int_distribution<size_t>(
+        0, choices.size() - 1)(rng)];
+  };
+  const std::vector<std::string> agents = {"FooBot", "BarBot", "*"};
+  const std::vector<std::string> segments = {"/", "a", "b", "ab", "*", "/a"};
+  const std::vector<std::string> paths = {
+      "/",    "/a",        "/b",    "/ab",  "/a/",   "/a/b", "/aab",
+      "/ba/", "/ab/index.html", "/ab/", "/b/ab", "/a/a", "/abab"};
+  const std::vector<std::string> line_endings = {"\n", "\r\n", "\r"};
+  for (int file = 0; file < 200; ++file) {
+    std::string robotstxt;
+    for (int line = 0; line < 12; ++line) {
+      if (line > 0) robotstxt += pick(line_endings);
+      switch (std::uniform_int_distribution<int>(0, 4)(rng)) {
+        case 0:
+          absl::StrAppend(&robotstxt, "user-agent: ", pick(agents));
+          break;
+        case 1:
+          robotstxt += pick({"", "# comment", "sitemap: http://foo.bar/s"});
+          break;
+        default: {
+          std::string pattern;
+          const int num_segments = std::uniform_int_distribution<int>(0, 3)(rng);
+          for (int i = 0; i < num_segments; ++i) pattern += pick(segments);
+          if (std::uniform_int_distribution<int>(0, 4)(rng) == 0) {
+            pattern += "$";
+          } else if (std::uniform_int_distribution<int>(0, 8)(rng) == 0) {
+            pattern += "/index.html";
+          }
+          absl::StrAppend(&robotstxt, pick({"allow", "disallow"}), ": ",
+                          pattern);
+        }
+      }
+    }
+    for (const std::string& path : paths) {
+      IsUserAgentAllowed(robotstxt, "FooBot", "http://foo.bar" + path);
+      IsUserAgentAllowed(robotstxt, "BazBot", "http://foo.bar" + path);
+    }
+  }
+}
+
+// The decisive path goes as far as the longest pattern applying to the user
+// agent, unless a wildcard can look further.
+TEST(CompiledRobotsUnittest, GetDecisivePath) {
+  const CompiledRobots robots(
+      "user-agent: *\n"
+      "disallow: /product/\n"
+      "allow: /product/public$\n"
+      "\n"
+      "user-agent: FooBot\n"
+      "disallow: /tmp**\n"
+      "\n"
+      "user-agent: BarBot\n"
+      "disallow: /*.pdf\n");
+  std::string buffer;
+  absl::string_view decisive_path;
+  ASSERT_TRUE(robots.GetDecisivePath(
+      "QuxBot", "http://foo.bar/product/123?ref=abc", &buffer, &decisive_path));
+  EXPECT_EQ("/product/123?ref", decisive_path);
+  ASSERT_TRUE(robots.GetDecisivePath("QuxBot", "http://foo.bar/product",
+                                     &buffer, &decisive_path));
+  EXPECT_EQ("/product", decisive_path);
+  ASSERT_TRUE(robots.GetDecisivePath("foobot", "http://foo.bar/tmp/a", &buffer,
+                                     &decisive_path));
+  EXPECT_EQ("/tmp", decisive_path);
+  EXPECT_FALSE(robots.GetDecisivePath("BarBot", "http://foo.bar/a.pdf",
+                                      &buffer, &decisive_path));
+}
+
+// The flat binary format can be read at any address, and data that isn't in
+// the format gives an invalid view.
+TEST(CompiledRobotsUnittest, CompiledRobotsView) {
+  const absl::string_view robotstxt =
+      "user-agent: *\n"
+      "disallow: /\n"
+      "\n"
+      "user-agent: FooBot\n"
+      "user-agent: BarBot\n"
+      "allow: /public\n"
+      "disallow: /*.pdf$\n"
+      "\n"
+      "user-agent: BazBot\n"
+      "disallow: /\n";
+  const CompiledRobots robots(robotstxt);
+  const std::string serialized = robots.Serialize();
+
+  // Copied at an odd offset of a larger buffer.
+  const std::string buffer = "x" + serialized + "yz";
+  const googlebot::CompiledRobotsView view(
+      absl::string_view(buffer).substr(1, serialized.size()));
+  ASSERT_TRUE(view.valid());
+  for (const char* agent : {"FooBot", "foobot", "BARBOT", "BazBot", "QuxBot"}) {
+    for (const char* url : {"http://foo.bar/", "http://foo.bar/public",
+                            "http://foo.bar/public/a.pdf", ""}) {
+      const googlebot::RobotsVerdict expected = robots.Evaluate(agent, url);
+      const googlebot::RobotsVerdict verdict = view.Evaluate(agent, url);
+      EXPECT_EQ(expected.allowed, verdict.allowed) << agent << " " << url;
+      EXPECT_EQ(expected.matching_line, verdict.matching_line)
+          << agent << " " << url;
+    }
+    EXPECT_EQ(robots.GetHostVerdict(agent), view.GetHostVerdict(agent));
+  }
+  const std::vector<absl::string_view> agents = {"QuxBot", "BazBot", "FooBot"};
+  EXPECT_FALSE(view.AllowedByRobots(agents, "http://foo.bar/a.pdf"));
+  EXPECT_TRUE(view.AllowedByRobots(agents, "http://foo.bar/public/a.html"));
+  EXPECT_EQ(googlebot::HostVerdict::PER_URL, view.GetHostVerdict(agents));
+  EXPECT_FALSE(view.allows_all());
+  EXPECT_FALSE(view.disallows_all());
+
+  const std::string disallow_all =
+      CompiledRobots("user-agent: *\ndisallow: /\n").Serialize();
+  const googlebot::CompiledRobotsView disallow_all_view(disallow_all);
+  EXPECT_TRUE(disallow_all_view.disallows_all());
+  EXPECT_FALSE(disallow_all_view.IsAllowed("FooBot", "http://foo.bar/"));
+
+  // Invalid data allows everything.
+  std::string bad_magic = serialized;
+  bad_magic[0] = 'X';
+  std::string bad_version = serialized;
+  bad_version[4] = static_cast<char>(
+      googlebot::CompiledRobotsView::kFormatVersion + 1);
+  std::string bad_offset = serialized;
+  bad_offset[24] = static_cast<char>(0xff);
+  bad_offset[25] = static_cast<char>(0xff);
+  for (const absl::string_view data :
+       {absl::string_view(), absl::string_view(serialized).substr(0, 40),
+        absl::string_view(serialized).substr(0, serialized.size() - 1),
+        absl::string_view(bad_magic), absl::string_view(bad_version),
+        absl::string_view(bad_offset)}) {
+    const googlebot::CompiledRobotsView invalid(data);
+    EXPECT_FALSE(invalid.valid());
+    EXPECT_TRUE(invalid.IsAllowed("FooBot", "http://foo.bar/a.pdf"));
+    EXPECT_TRUE(invalid.allows_all());
+    EXPECT_EQ(0, invalid.Evaluate("FooBot", "http://foo.bar/").matching_line);
+  }
+}
+
 }  // namespace
 
 // Integrity tests. These functions are available to the linker, but not in the
 // header, because they should only be used for testing.
 namespace googlebot {
 std::string GetPathParamsQuery(const std::string& url);
+absl::string_view GetPathParamsQuery(absl::string_view url,
+                                     std::string* buffer);
 bool MaybeEscapePattern(const char* src, char** dst);
+absl::string_view MaybeEscapePattern(absl::string_view src,
+                                     std::string* buffer);
+bool MatchesPositionSet(absl::string_view path, absl::string_view pattern);
+bool MatchesBitParallel(absl::string_view path, absl::string_view pattern);
+const char* FindLineEnd(const char* begin, const char* end);
 }  // namespace googlebot
 
 void TestPath(const std::string& url, const std::string& expected_path) {
   EXPECT_EQ(expected_path, googlebot::GetPathParamsQuery(url));
+  std::string buffer;
+  EXPECT_EQ(expected_path, googlebot::GetPathParamsQuery(
+                               absl::string_view(url), &buffer));
 }
 
 void TestEscape(const std::string& url, const std::string& expected) {
@@ -1008,9 +1817,245 @@ TEST(RobotsUnittest, TestGetPathParamsQuery) {
   TestPath("//a/b/c", "/b/c");
 }
 
+TEST(RobotsUnittest, TestGetPathParamsQueryReturnsViewIntoUrl) {
+  const absl::string_view url = "http://www.example.com/a/b?c=d#fragment";
+  std::string buffer;
+  const absl::string_view path = googlebot::GetPathParamsQuery(url, &buffer);
+  EXPECT_EQ("/a/b?c=d", path);
+  EXPECT_EQ(url.data() + strlen("http://www.example.com"), path.data());
+  EXPECT_TRUE(buffer.empty());
+
+  // A slash has to be prepended, so the result is in the buffer.
+  const absl::string_view query = googlebot::GetPathParamsQuery(
+      "http://www.example.com?a=b", &buffer);
+  EXPECT_EQ("/?a=b", query);
+  EXPECT_EQ(buffer.data(), query.data());
+}
+
+// Checks with string_view URLs and user agents must not allocate once the
+// robots.txt is compiled.
+TEST(RobotsUnittest, StringViewChecksDontAllocate) {
+  const googlebot::CompiledRobots robots(
+      "user-agent: FooBot\n"
+      "allow: /a/public\n"
+      "disallow: /a/\n"
+      "disallow: /*.json$\n"
+      "user-agent: *\n"
+      "disallow: /\n");
+  const absl::string_view user_agents[] = {"BarBot", "FooBot"};
+  const absl::string_view urls[] = {
+      "http://foo.bar/a/public/index.html",
+      "http://foo.bar/a/private?q=1#fragment",
+      "http://foo.bar/b/data.json",
+      "http://foo.bar/c/d;e",
+  };
+  std::string buffer;
+
+  const int64_t num_allocations_before = googlebot::NumAllocations();
+  int num_allowed = 0;
+  for (int i = 0; i < 100; ++i) {
+    for (const absl::string_view url : urls) {
+      num_allowed += robots.IsAllowed("FooBot", url);
+      num_allowed += robots.AllowedByRobots(user_agents, url);
+      num_allowed += robots.Evaluate(user_agents, url).allowed;
+      num_allowed += googlebot::GetPathParamsQuery(url, &buffer).size() > 1;
+    }
+  }
+  EXPECT_EQ(num_allocations_before, googlebot::NumAllocations());
+  EXPECT_EQ(100 * (3 * 2 + 4), num_allowed);
+}
+
+// A RobotsMatcher reuses its parse buffers, so that checking more URLs doesn't
+// allocate once it has parsed a robots.txt.
+TEST(RobotsUnittest, RepeatedMatchesDontAllocate) {
+  const absl::string_view robotstxt =
+      "user-agent: FooBot\n"
+      "allow: /a/public\n"
+      "disallow: /a/\n"
+      "disallow: /f\xC3\xBC\n"
+      "disallow: /%aa/\n"
+      "allow: /b/index.html\n"
+      "user-agent: *\n"
+      "disallow: /\n";
+  const absl::string_view user_agents[] = {"FooBot"};
+  const absl::string_view urls[] = {
+      "http://foo.bar/a/public/index.html",
+      "http://foo.bar/a/private",
+      "http://foo.bar/f%C3%BC",
+      "http://foo.bar/%AA/",
+      "http://foo.bar/b/",
+  };
+  RobotsMatcher matcher;
+  for (const absl::string_view url : urls) {
+    matcher.AllowedByRobots(robotstxt, user_agents, url);
+  }
+
+  const int64_t num_allocations_before = googlebot::NumAllocations();
+  int num_allowed = 0;
+  for (int i = 0; i < 100; ++i) {
+    for (const absl::string_view url : urls) {
+      num_allowed += matcher.AllowedByRobots(robotstxt, user_agents, url);
+      num_allowed += matcher.OneAgentAllowedByRobots(robotstxt, "FooBot", url);
+    }
+  }
+  EXPECT_EQ(num_allocations_before, googlebot::NumAllocations());
+  EXPECT_EQ(100 * 2 * 2, num_allowed);
+}
+
+TEST(RobotsUnittest, TestMaybeEscapePatternIntoBuffer) {
+  std::string buffer;
+  const absl::string_view unchanged = "/a/b?c=%2F";
+  EXPECT_EQ(unchanged.data(),
+            googlebot::MaybeEscapePattern(unchanged, &buffer).data());
+  EXPECT_EQ("/%AA/%C3%BC",
+            googlebot::MaybeEscapePattern("/%aa/\xC3\xBC", &buffer));
+  // A '%' too close to the end isn't an escape sequence.
+  EXPECT_EQ("/%A%C3%BC", googlebot::MaybeEscapePattern("/%A\xC3\xBC", &buffer));
+  EXPECT_EQ("/%a", googlebot::MaybeEscapePattern("/%a", &buffer));
+}
+
 TEST(RobotsUnittest, TestMaybeEscapePattern) {
   TestEscape("http://www.example.com", "http://www.example.com");
   TestEscape("/a/b/c", "/a/b/c");
   TestEscape("á", "%C3%A1");
   TestEscape("%aa", "%AA");
 }
+
+// The bit-parallel matcher must agree with the position set matcher, which
+// stays the reference implementation.
+TEST(RobotsUnittest, TestMatchesBitParallel) {
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"/", ""},          {"/", "$"},          {"", "$"},
+      {"/", "*"},         {"/", "*$"},         {"/a$b", "/a$b"},
+      {"/a$", "/a$$"},    {"/a", "/a$$"},      {"/abc", "/a*c$"},
+      {"/abcd", "/a*c$"}, {"/abcd", "/a*c"},   {"/fish.php?id=1", "/*.php"},
+      {"/a/b/c", "/**c"}, {"/a/b/c", "/*/*/"}, {"/aaa", "/a*a*a*a"},
+  };
+  for (const auto& test_case : cases) {
+    EXPECT_EQ(googlebot::MatchesPositionSet(test_case.first, test_case.second),
+              googlebot::MatchesBitParallel(test_case.first, test_case.second))
+        << "path: " << test_case.first << " pattern: " << test_case.second;
+  }
+
+  // Random paths and patterns over a small alphabet, so that they match often.
+  std::mt19937 rng(42);
+  const auto random_string = [&rng](absl::string_view alphabet, int max_len) {
+    std::string result;
+    const int len = std::uniform_int_distribution<int>(0, max_len)(rng);
+    for (int i = 0; i < len; ++i) {
+      result += alphabet[std::uniform_int_distribution<size_t>(
+          0, alphabet.size() - 1)(rng)];
+    }
+    return result;
+  };
+  for (int i = 0; i < 20000; ++i) {
+    const std::string path = "/" + random_string("/ab$", 12);
+    const std::string pattern = random_string("/ab*$", 8);
+    const bool expected = googlebot::MatchesPositionSet(path, pattern);
+    EXPECT_EQ(expected, googlebot::MatchesBitParallel(path, pattern))
+        << "path: " << path << " pattern: " << pattern;
+    EXPECT_EQ(expected, googlebot::WildcardPattern(pattern).Matches(path))
+        << "path: " << path << " pattern: " << pattern;
+  }
+}
+
+// Only the characters from the first '*' on count against the limit of the
+// automaton, the literal prefix is compared as is.
+TEST(RobotsUnittest, TestWildcardPattern) {
+  const std::string directory = "/" + std::string(100, 'd') + "/";
+  EXPECT_TRUE(googlebot::WildcardPattern::Fits(directory + "*.pdf"));
+  EXPECT_TRUE(googlebot::WildcardPattern::Fits(directory));
+  EXPECT_TRUE(
+      googlebot::WildcardPattern::Fits("/*" + std::string(63, 'a') + "$"));
+  EXPECT_FALSE(googlebot::WildcardPattern::Fits("/*" + std::string(64, 'a')));
+  EXPECT_FALSE(
+      googlebot::WildcardPattern::Fits("/*" + std::string(63, 'a') + "$$"));
+
+  const googlebot::WildcardPattern pattern(directory + "*.pdf$");
+  const std::string path = directory + "a/b.pdf";
+  const std::string path_with_query = path + "?x";
+  const int64_t num_allocations_before = googlebot::NumAllocations();
+  EXPECT_TRUE(pattern.Matches(path));
+  EXPECT_FALSE(pattern.Matches(path_with_query));
+  EXPECT_FALSE(pattern.Matches("/d/a/b.pdf"));
+  EXPECT_EQ(num_allocations_before, googlebot::NumAllocations());
+  EXPECT_TRUE(googlebot::MatchesBitParallel(path, directory + "*.pdf$"));
+
+  // Rules with long prefixes agree with the matcher, as do those with too
+  // many characters after a '*' for the automaton.
+  const std::string many_chars(120, 'a');
+  const std::string robotstxt =
+      absl::StrCat("user-agent: FooBot\n", "disallow: ", directory, "*.pdf\n",
+                   "allow: /*", many_chars, "\n");
+  EXPECT_FALSE(IsUserAgentAllowed(robotstxt, "FooBot",
+                                  "http://foo.bar" + directory + "x/y.pdf"));
+  EXPECT_TRUE(IsUserAgentAllowed(robotstxt, "FooBot",
+                                 "http://foo.bar" + directory + "x/y.html"));
+  EXPECT_TRUE(IsUserAgentAllowed(
+      robotstxt, "FooBot",
+      "http://foo.bar" + directory + "x/" + many_chars + ".pdf"));
+}
+
+TEST(RobotsUnittest, TestFindLineEnd) {
+  // Line endings at every offset of buffers longer than a vector register,
+  // with and without bytes that have their high bit set.
+  for (const char filler : {'a', '\xFF'}) {
+    for (size_t size = 0; size <= 70; ++size) {
+      std::string buffer(size, filler);
+      const char* const begin = buffer.data();
+      EXPECT_EQ(begin + size, googlebot::FindLineEnd(begin, begin + size));
+      for (size_t i = 0; i < size; ++i) {
+        for (const char line_end : {'\n', '\r'}) {
+          buffer[i] = line_end;
+          if (i + 1 < size) buffer[size - 1] = '\r';
+          EXPECT_EQ(begin + i, googlebot::FindLineEnd(begin, begin + size))
+              << "size: " << size << " offset: " << i;
+          // Bytes past the end are not looked at.
+          EXPECT_EQ(begin + i, googlebot::FindLineEnd(begin, begin + i));
+          buffer.assign(size, filler);
+        }
+      }
+    }
+  }
+}
+
+TEST(RobotsUnittest, TestUserAgentSet) {
+  googlebot::UserAgentSet set;
+  EXPECT_EQ(-1, set.Find("FooBot"));
+  EXPECT_EQ(0, set.Insert("FooBot"));
+  EXPECT_EQ(1, set.Insert("BarBot"));
+  EXPECT_EQ(0, set.Insert("foobot"));
+  EXPECT_EQ(2, set.size());
+  EXPECT_EQ(0, set.Find("FOOBOT"));
+  EXPECT_TRUE(set.Contains("barbot"));
+  EXPECT_FALSE(set.Contains("Foo"));
+  EXPECT_FALSE(set.Contains(""));
+
+  // Members survive the set growing.
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i + 2, set.Insert(absl::StrCat("Bot", i)));
+  }
+  EXPECT_EQ(102, set.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i + 2, set.Find(absl::StrCat("BOT", i)));
+  }
+  EXPECT_EQ(0, set.Find("FooBot"));
+
+  set.Clear();
+  EXPECT_EQ(0, set.size());
+  EXPECT_FALSE(set.Contains("FooBot"));
+  EXPECT_EQ(0, set.Insert("Bot7"));
+}
+
+// Patterns too long for the bit-parallel matcher still match.
+TEST(RobotsUnittest, GoogleOnly_LongPatterns) {
+  const std::string segment(40, 'a');
+  const std::string path = absl::StrCat("/", segment, "/", segment, "/x.html");
+  const std::string robotstxt =
+      absl::StrCat("user-agent: FooBot\n", "disallow: /", segment, "/",
+                   segment.substr(0, 30), "*.html$\n");
+  EXPECT_FALSE(IsUserAgentAllowed(robotstxt, "FooBot",
+                                  absl::StrCat("http://foo.bar", path)));
+  EXPECT_TRUE(IsUserAgentAllowed(robotstxt, "FooBot",
+                                 absl::StrCat("http://foo.bar", path, "?")));
+}